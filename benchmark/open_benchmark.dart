@@ -0,0 +1,92 @@
+import 'dart:async';
+import 'dart:io';
+import 'dart:math';
+
+import 'package:leveldb/leveldb.dart';
+
+const int _dbCount = 40;
+const int _keysPerDb = 20000;
+const int _readsPerDb = 1000;
+const int _hotKeys = 100;
+
+/// This benchmark measures the time to open many databases and the latency of the first reads afterwards.
+///
+/// Each database is opened one at a time with [LevelDB.open], then all at once with [LevelDB.openAll], and
+/// finally with [LevelDB.openAll] and `warmUp: true`. The page cache is not dropped between runs so the
+/// results show the cost in the library and leveldb rather than the disk.
+Future<Null> main() async {
+  List<String> paths = new Iterable<int>.generate(_dbCount)
+      .map((int i) => '/tmp/leveldb-open-benchmark-$i')
+      .toList();
+  await _populate(paths);
+
+  await _run('open (sequential)', paths, () async {
+    List<LevelDB<String, String>> dbs = <LevelDB<String, String>>[];
+    for (String path in paths) {
+      dbs.add(await LevelDB.openUtf8(path));
+    }
+    return dbs;
+  });
+
+  for (int concurrency in <int>[1, 4, 16]) {
+    await _run(
+        'openAll (concurrency: $concurrency)',
+        paths,
+        () => LevelDB.openAll(paths,
+            concurrency: concurrency,
+            keyEncoding: LevelDB.utf8,
+            valueEncoding: LevelDB.utf8));
+  }
+
+  await _run(
+      'openAll (concurrency: 4, warmUp)',
+      paths,
+      () => LevelDB.openAll(paths,
+          concurrency: 4,
+          warmUp: true,
+          hotRanges: <LevelKeyRange<String>>[
+            new LevelKeyRange<String>(gte: _key(0), lt: _key(_hotKeys))
+          ],
+          keyEncoding: LevelDB.utf8,
+          valueEncoding: LevelDB.utf8));
+}
+
+Future<Null> _populate(List<String> paths) async {
+  for (String path in paths) {
+    if (new Directory(path).existsSync()) {
+      continue;
+    }
+    LevelDB<String, String> db = await LevelDB.openUtf8(path);
+    for (int i = 0; i < _keysPerDb; i++) {
+      db.put(_key(i), 'value-$i-${'x' * 100}');
+    }
+    db.close();
+  }
+}
+
+String _key(int i) => 'key-${i.toString().padLeft(8, '0')}';
+
+Future<Null> _run(String name, List<String> paths,
+    Future<List<LevelDB<String, String>>> open()) async {
+  Stopwatch openWatch = new Stopwatch()..start();
+  List<LevelDB<String, String>> dbs = await open();
+  openWatch.stop();
+
+  // Read keys from the start of the key space (the hot range used by the warm up) in every db.
+  Random random = new Random(0);
+  Stopwatch readWatch = new Stopwatch()..start();
+  for (LevelDB<String, String> db in dbs) {
+    for (int i = 0; i < _readsPerDb; i++) {
+      db.get(_key(random.nextInt(_hotKeys)));
+    }
+  }
+  readWatch.stop();
+
+  for (LevelDB<String, String> db in dbs) {
+    db.close();
+  }
+
+  int reads = paths.length * _readsPerDb;
+  print('$name: open ${openWatch.elapsedMilliseconds}ms, '
+      'first reads ${(readWatch.elapsedMicroseconds / reads).toStringAsFixed(2)}us/get');
+}
@@ -1,23 +1,52 @@
 
+#include <errno.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <list>
 #include <deque>
 #include <string>
 #include <map>
+#include <vector>
 #include <cstring>
 
 #include "include/dart_api.h"
 #include "include/dart_native_api.h"
 
 #include "leveldb/db.h"
+#include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/write_batch.h"
+#include "helpers/memenv/memenv.h"
 
 
 const int BLOOM_BITS_PER_KEY = 10;
 
+// Values in a ttl db are prefixed with a little endian uint64 expiry time in milliseconds since the epoch.
+// An expiry time of 0 means the value never expires.
+const size_t TTL_HEADER_SIZE = 8;
+
+// Number of expired keys the reaper collects before deleting them.
+const int TTL_REAP_BATCH_SIZE = 256;
+
+// Number of expired keys the reaper re-checks and deletes whilst holding the ttl write lock. Writers to the db wait
+// for at most this many reads and one write.
+const int TTL_REAP_LOCK_SIZE = 16;
+
+// A file in the directory of a db opened with ttl. Its presence records that the values have an expiry header.
+const char* TTL_MARKER_FILE = "LEVELDB_DART_TTL";
+
+// Suffix of the files a checkpoint writes before moving them into place. leveldb ignores these files.
+const char* CHECKPOINT_TMP_SUFFIX = ".dbtmp";
+
+// The rate limiter bucket holds at most this many microseconds of tokens.
+const int64_t RATE_LIMIT_BURST_MICROS = 100000;
+
 
 Dart_NativeFunction ResolveName(Dart_Handle name,
                                 int argc,
@@ -57,8 +86,338 @@ int64_t statusToError(leveldb::Status status) {
 }
 
 
+int64_t nowMillis() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((int64_t) ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+int64_t nowMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t) ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+void encodeExpiry(char* dst, int64_t expiry) {
+    for (size_t i = 0; i < TTL_HEADER_SIZE; i++) {
+        dst[i] = (expiry >> (8 * i)) & 0xFF;
+    }
+}
+
+
+int64_t decodeExpiry(const char* src) {
+    uint64_t expiry = 0;
+    for (size_t i = 0; i < TTL_HEADER_SIZE; i++) {
+        expiry |= ((uint64_t) (uint8_t) src[i]) << (8 * i);
+    }
+    return (int64_t) expiry;
+}
+
+
+/// Return true if a raw ttl db value has expired at time now. The value must be at least TTL_HEADER_SIZE long.
+bool isExpired(const leveldb::Slice& value, int64_t now) {
+    int64_t expiry = decodeExpiry(value.data());
+    return expiry != 0 && expiry <= now;
+}
+
+
+bool hasSuffix(const std::string& s, const char* suffix) {
+  size_t len = strlen(suffix);
+  return s.size() >= len && s.compare(s.size() - len, len, suffix) == 0;
+}
+
+
+/// I/O counters for a db. Updated by the files opened through DBEnv.
+struct IOStats {
+  std::atomic<int64_t> bytes_read;
+  std::atomic<int64_t> bytes_written;
+  std::atomic<int64_t> syncs;
+  std::atomic<int64_t> throttled_micros;
+};
+
+
+/// A token bucket. Callers take tokens for the bytes they are about to write and sleep if the bucket is in debt.
+/// The bucket holds at most RATE_LIMIT_BURST_MICROS of tokens.
+class RateLimiter {
+ public:
+  explicit RateLimiter(int64_t bytes_per_second)
+      : bytes_per_second(bytes_per_second), burst(std::max<int64_t>(bytes_per_second / (1000000 / RATE_LIMIT_BURST_MICROS), 1)), available(burst),
+        last_refill_micros(nowMicros()) {
+    pthread_mutex_init(&mutex, NULL);
+  }
+
+  ~RateLimiter() {
+    pthread_mutex_destroy(&mutex);
+  }
+
+  /// Take tokens for bytes. Returns the number of microseconds slept.
+  int64_t Request(int64_t bytes) {
+    pthread_mutex_lock(&mutex);
+    int64_t now = nowMicros();
+    // Refilling for longer than the burst window would be clamped anyway. Clamp the elapsed time first so that
+    // the multiplication cannot overflow after a long idle period.
+    int64_t elapsed = std::min<int64_t>(now - last_refill_micros, RATE_LIMIT_BURST_MICROS);
+    available += elapsed * bytes_per_second / 1000000;
+    if (available > burst) {
+      available = burst;
+    }
+    last_refill_micros = now;
+    available -= bytes;
+    int64_t wait_micros = available < 0 ? -available * 1000000 / bytes_per_second : 0;
+    pthread_mutex_unlock(&mutex);
+
+    if (wait_micros > 0) {
+      usleep(wait_micros);
+    }
+    return wait_micros;
+  }
+
+ private:
+  pthread_mutex_t mutex;
+  const int64_t bytes_per_second;
+  const int64_t burst;
+  int64_t available;
+  int64_t last_refill_micros;
+};
+
+
+class CountingSequentialFile : public leveldb::SequentialFile {
+ public:
+  CountingSequentialFile(leveldb::SequentialFile* target, IOStats* stats) : target(target), stats(stats) {}
+  ~CountingSequentialFile() override { delete target; }
+
+  leveldb::Status Read(size_t n, leveldb::Slice* result, char* scratch) override {
+    leveldb::Status status = target->Read(n, result, scratch);
+    stats->bytes_read += result->size();
+    return status;
+  }
+
+  leveldb::Status Skip(uint64_t n) override {
+    return target->Skip(n);
+  }
+
+ private:
+  leveldb::SequentialFile* target;
+  IOStats* stats;
+};
+
+
+class CountingRandomAccessFile : public leveldb::RandomAccessFile {
+ public:
+  CountingRandomAccessFile(leveldb::RandomAccessFile* target, IOStats* stats) : target(target), stats(stats) {}
+  ~CountingRandomAccessFile() override { delete target; }
+
+  leveldb::Status Read(uint64_t offset, size_t n, leveldb::Slice* result, char* scratch) const override {
+    leveldb::Status status = target->Read(offset, n, result, scratch);
+    stats->bytes_read += result->size();
+    return status;
+  }
+
+ private:
+  leveldb::RandomAccessFile* target;
+  IOStats* stats;
+};
+
+
+/// Counts writes and syncs. If limiter is not NULL appends are rate limited.
+class CountingWritableFile : public leveldb::WritableFile {
+ public:
+  CountingWritableFile(leveldb::WritableFile* target, IOStats* stats, RateLimiter* limiter)
+      : target(target), stats(stats), limiter(limiter) {}
+  ~CountingWritableFile() override { delete target; }
+
+  leveldb::Status Append(const leveldb::Slice& data) override {
+    if (limiter != NULL) {
+      stats->throttled_micros += limiter->Request(data.size());
+    }
+    leveldb::Status status = target->Append(data);
+    if (status.ok()) {
+      stats->bytes_written += data.size();
+    }
+    return status;
+  }
+
+  leveldb::Status Close() override {
+    return target->Close();
+  }
+
+  leveldb::Status Flush() override {
+    return target->Flush();
+  }
+
+  leveldb::Status Sync() override {
+    stats->syncs += 1;
+    return target->Sync();
+  }
+
+ private:
+  leveldb::WritableFile* target;
+  IOStats* stats;
+  RateLimiter* limiter;
+};
+
+
+/// The Env used by every db. Wraps the base Env so that:
+///  - file removal can be paused whilst a checkpoint is reading the db directory.
+///  - bytes read and written and syncs are counted.
+///  - writes to table files are rate limited if compaction_bytes_per_second > 0. Table files are only written by
+///    memtable flushes and compactions so foreground writes to the log are never limited.
+class DBEnv : public leveldb::EnvWrapper {
+ public:
+  DBEnv(leveldb::Env* target, int64_t compaction_bytes_per_second)
+      : leveldb::EnvWrapper(target), pause_count(0), is_background_started(false), is_background_stopping(false) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&background_cond, NULL);
+    stats.bytes_read = 0;
+    stats.bytes_written = 0;
+    stats.syncs = 0;
+    stats.throttled_micros = 0;
+    limiter = compaction_bytes_per_second > 0 ? new RateLimiter(compaction_bytes_per_second) : NULL;
+  }
+
+  ~DBEnv() {
+    // leveldb waits for scheduled work to finish before the db is deleted so the queue is empty here.
+    if (is_background_started) {
+      pthread_mutex_lock(&mutex);
+      is_background_stopping = true;
+      pthread_cond_signal(&background_cond);
+      pthread_mutex_unlock(&mutex);
+      pthread_join(background_thread, NULL);
+    }
+    delete limiter;
+    pthread_cond_destroy(&background_cond);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  // Every db using the default Env shares a single background thread for flushes and compactions. A rate limited
+  // db sleeps on the thread which writes its tables so it runs them on its own thread. Otherwise the limit would
+  // stall the background work of every other db.
+  void Schedule(void (*function)(void* arg), void* arg) override {
+    if (limiter == NULL) {
+      target()->Schedule(function, arg);
+      return;
+    }
+    pthread_mutex_lock(&mutex);
+    if (!is_background_started) {
+      int rc = pthread_create(&background_thread, NULL, runBackground, (void*) this);
+      assert(rc == 0);
+      is_background_started = true;
+    }
+    background_queue.push_back(std::make_pair(function, arg));
+    pthread_cond_signal(&background_cond);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  leveldb::Status NewSequentialFile(const std::string& fname, leveldb::SequentialFile** result) override {
+    leveldb::SequentialFile* file;
+    leveldb::Status status = target()->NewSequentialFile(fname, &file);
+    *result = status.ok() ? new CountingSequentialFile(file, &stats) : NULL;
+    return status;
+  }
+
+  leveldb::Status NewRandomAccessFile(const std::string& fname, leveldb::RandomAccessFile** result) override {
+    leveldb::RandomAccessFile* file;
+    leveldb::Status status = target()->NewRandomAccessFile(fname, &file);
+    *result = status.ok() ? new CountingRandomAccessFile(file, &stats) : NULL;
+    return status;
+  }
+
+  leveldb::Status NewWritableFile(const std::string& fname, leveldb::WritableFile** result) override {
+    leveldb::WritableFile* file;
+    leveldb::Status status = target()->NewWritableFile(fname, &file);
+    *result = status.ok() ? new CountingWritableFile(file, &stats, limiterFor(fname)) : NULL;
+    return status;
+  }
+
+  leveldb::Status NewAppendableFile(const std::string& fname, leveldb::WritableFile** result) override {
+    leveldb::WritableFile* file;
+    leveldb::Status status = target()->NewAppendableFile(fname, &file);
+    *result = status.ok() ? new CountingWritableFile(file, &stats, limiterFor(fname)) : NULL;
+    return status;
+  }
+
+  leveldb::Status RemoveFile(const std::string& fname) override {
+    pthread_mutex_lock(&mutex);
+    if (pause_count > 0) {
+      // The file is no longer part of the db but a checkpoint may still be reading it.
+      deferred_removals.push_back(fname);
+      pthread_mutex_unlock(&mutex);
+      return leveldb::Status::OK();
+    }
+    pthread_mutex_unlock(&mutex);
+    return target()->RemoveFile(fname);
+  }
+
+  void PauseFileRemoval() {
+    pthread_mutex_lock(&mutex);
+    pause_count += 1;
+    pthread_mutex_unlock(&mutex);
+  }
+
+  void ResumeFileRemoval() {
+    std::vector<std::string> removals;
+    pthread_mutex_lock(&mutex);
+    pause_count -= 1;
+    if (pause_count == 0) {
+      removals.swap(deferred_removals);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    for (std::vector<std::string>::iterator it = removals.begin(); it != removals.end(); ++it) {
+      target()->RemoveFile(*it);
+    }
+  }
+
+  IOStats stats;
+
+ private:
+  static void* runBackground(void* ptr) {
+    DBEnv* env = (DBEnv*) ptr;
+    pthread_mutex_lock(&env->mutex);
+    while (true) {
+      while (env->background_queue.empty() && !env->is_background_stopping) {
+        pthread_cond_wait(&env->background_cond, &env->mutex);
+      }
+      if (env->background_queue.empty()) {
+        break;
+      }
+      std::pair<void (*)(void*), void*> work = env->background_queue.front();
+      env->background_queue.pop_front();
+      pthread_mutex_unlock(&env->mutex);
+      work.first(work.second);
+      pthread_mutex_lock(&env->mutex);
+    }
+    pthread_mutex_unlock(&env->mutex);
+    return NULL;
+  }
+
+  RateLimiter* limiterFor(const std::string& fname) {
+    if (hasSuffix(fname, ".ldb") || hasSuffix(fname, ".sst")) {
+      return limiter;
+    }
+    return NULL;
+  }
+
+  pthread_mutex_t mutex;
+  int64_t pause_count;
+  std::vector<std::string> deferred_removals;
+  RateLimiter* limiter;
+
+  // Background thread of a rate limited db. Protected by mutex.
+  bool is_background_started;
+  bool is_background_stopping;
+  pthread_t background_thread;
+  pthread_cond_t background_cond;
+  std::deque<std::pair<void (*)(void*), void*> > background_queue;
+};
+
+
 struct DB {
   leveldb::DB *db;
+  DBEnv *env;
+  leveldb::Env *mem_env;  // The base env of an in memory db. NULL if the db is on disk.
   int64_t refcount;
 
   bool is_shared;
@@ -67,10 +426,33 @@ struct DB {
   bool create_if_missing;
   bool error_if_exists;
 
-  pthread_t thread;
   std::deque<Dart_Port> notify_list;
   int64_t open_status;
   pthread_mutex_t mutex;
+  // Signalled when open_status is set.
+  pthread_cond_t open_cond;
+
+  // Warm up. Progress of the open is posted to progress_port if it is not ILLEGAL_PORT.
+  bool is_warm_up;
+  std::vector<std::pair<std::string, std::string> > hot_ranges;  // [gte, lt) pairs. An empty key is unbounded.
+  Dart_Port progress_port;
+
+  // TTL. If is_ttl is true every value is stored with an expiry header.
+  bool is_ttl;
+  int64_t reap_interval_ms;  // The reaper thread is not started if this is <= 0.
+  bool is_reaper_running;
+  bool is_reaper_stopping;
+  pthread_t reaper_thread;
+  pthread_cond_t reaper_cond;
+  // Writers take a read lock so that the reaper can check a key is still expired before deleting it.
+  pthread_rwlock_t ttl_lock;
+
+  // Reaper statistics. Protected by mutex.
+  int64_t reap_sweeps;
+  int64_t reap_keys;
+  int64_t reap_bytes;
+  int64_t reap_last_keys;
+  int64_t reap_last_micros;
 };
 
 
@@ -86,33 +468,362 @@ pthread_mutex_t shared_mutex = PTHREAD_MUTEX_INITIALIZER;
 DBMap sharedDBs;
 
 
-void* runOpen(void* ptr) {
-    // This function may not take the shared mutex because we take it when joining to this thread.
+/// Delete a batch of expired keys. Each key is read again under the ttl write lock so that a value written since
+/// the sweep iterator saw the key is not deleted. The lock is released every TTL_REAP_LOCK_SIZE keys.
+void reapKeys(DB* native_db, const std::deque<std::string>& keys, int64_t now, int64_t* reaped_keys, int64_t* reaped_bytes) {
+    std::deque<std::string>::const_iterator it = keys.begin();
+    while (it != keys.end()) {
+        leveldb::WriteBatch batch;
+        int64_t batch_keys = 0;
+        int64_t batch_bytes = 0;
+
+        pthread_rwlock_wrlock(&native_db->ttl_lock);
+        for (int i = 0; i < TTL_REAP_LOCK_SIZE && it != keys.end(); i++, ++it) {
+            std::string value;
+            leveldb::Status status = native_db->db->Get(leveldb::ReadOptions(), *it, &value);
+            if (!status.ok() || value.size() < TTL_HEADER_SIZE || !isExpired(value, now)) {
+                continue;
+            }
+            batch.Delete(*it);
+            batch_keys += 1;
+            batch_bytes += it->size() + value.size();
+        }
+        // Every key may have been overwritten since the sweep. Skip the write so writers do not wait for it.
+        leveldb::Status status;
+        if (batch_keys > 0) {
+            status = native_db->db->Write(leveldb::WriteOptions(), &batch);
+        }
+        pthread_rwlock_unlock(&native_db->ttl_lock);
+
+        if (status.ok()) {
+            *reaped_keys += batch_keys;
+            *reaped_bytes += batch_bytes;
+        }
+    }
+}
+
+
+/// Scan the whole db and delete every expired key.
+void reapSweep(DB* native_db) {
+    int64_t start = nowMicros();
+    int64_t now = nowMillis();
+    int64_t reaped_keys = 0;
+    int64_t reaped_bytes = 0;
+    bool is_stopping = false;
+
+    leveldb::ReadOptions options;
+    options.fill_cache = false;
+    leveldb::Iterator* it = native_db->db->NewIterator(options);
+
+    std::deque<std::string> keys;
+    int64_t scanned = 0;
+    for (it->SeekToFirst(); it->Valid() && !is_stopping; it->Next()) {
+        leveldb::Slice value = it->value();
+        if (value.size() >= TTL_HEADER_SIZE && isExpired(value, now)) {
+            keys.push_back(it->key().ToString());
+        }
+        if (keys.size() >= TTL_REAP_BATCH_SIZE) {
+            reapKeys(native_db, keys, now, &reaped_keys, &reaped_bytes);
+            keys.clear();
+        }
+
+        // Check periodically if the db is closing so that a sweep over a large db does not hold up the close.
+        scanned += 1;
+        if (scanned % TTL_REAP_BATCH_SIZE == 0) {
+            pthread_mutex_lock(&native_db->mutex);
+            is_stopping = native_db->is_reaper_stopping;
+            pthread_mutex_unlock(&native_db->mutex);
+        }
+    }
+    if (!keys.empty() && !is_stopping) {
+        reapKeys(native_db, keys, now, &reaped_keys, &reaped_bytes);
+    }
+    delete it;
+
+    pthread_mutex_lock(&native_db->mutex);
+    native_db->reap_sweeps += 1;
+    native_db->reap_keys += reaped_keys;
+    native_db->reap_bytes += reaped_bytes;
+    native_db->reap_last_keys = reaped_keys;
+    native_db->reap_last_micros = nowMicros() - start;
+    pthread_mutex_unlock(&native_db->mutex);
+}
+
+
+void* runReaper(void* ptr) {
     DB *native_db = (DB*) ptr;
+
+    pthread_mutex_lock(&native_db->mutex);
+    while (!native_db->is_reaper_stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += native_db->reap_interval_ms / 1000;
+        deadline.tv_nsec += (native_db->reap_interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+        int rc = 0;
+        while (!native_db->is_reaper_stopping && rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&native_db->reaper_cond, &native_db->mutex, &deadline);
+        }
+        if (native_db->is_reaper_stopping) {
+            break;
+        }
+        pthread_mutex_unlock(&native_db->mutex);
+        reapSweep(native_db);
+        pthread_mutex_lock(&native_db->mutex);
+    }
+    pthread_mutex_unlock(&native_db->mutex);
+    return NULL;
+}
+
+
+const int64_t OPEN_PHASE_OPENED = 0;
+const int64_t OPEN_PHASE_WARMED = 1;
+
+
+void postIntegerList(Dart_Port port, const int64_t* values, int count) {
+  std::vector<Dart_CObject> objects(count);
+  std::vector<Dart_CObject*> object_pointers(count);
+  for (int i = 0; i < count; i++) {
+    objects[i].type = Dart_CObject_kInt64;
+    objects[i].value.as_int64 = values[i];
+    object_pointers[i] = &objects[i];
+  }
+
+  Dart_CObject message;
+  message.type = Dart_CObject_kArray;
+  message.value.as_array.length = count;
+  message.value.as_array.values = object_pointers.data();
+  Dart_PostCObject(port, &message);
+}
+
+
+void postOpenProgress(DB* native_db, int64_t phase, int64_t start, int64_t tables, int64_t bytes) {
+  if (native_db->progress_port == ILLEGAL_PORT) {
+    return;
+  }
+  int64_t progress[] = {phase, nowMicros() - start, tables, bytes};
+  postIntegerList(native_db->progress_port, progress, sizeof(progress) / sizeof(progress[0]));
+}
+
+
+/// Return the smallest key of every table in the db. leveldb does not expose the table metadata so the keys are
+/// parsed from the leveldb.sstables debug property which lists each table as:
+///     <number>:<size>['<escaped smallest key>' @ <seq> : <type> .. '<escaped largest key>' @ <seq> : <type>]
+/// Keys which cannot be parsed are skipped.
+std::vector<std::string> tableSmallestKeys(leveldb::DB* db) {
+  std::vector<std::string> keys;
+  std::string tables;
+  if (!db->GetProperty("leveldb.sstables", &tables)) {
+    return keys;
+  }
+  size_t pos = 0;
+  while ((pos = tables.find("['", pos)) != std::string::npos) {
+    size_t start = pos + 2;
+    size_t end = tables.find("' @ ", start);
+    if (end == std::string::npos) {
+      break;
+    }
+    std::string key;
+    for (size_t i = start; i < end; i++) {
+      if (tables[i] == '\\' && i + 3 < end && tables[i + 1] == 'x') {
+        key.push_back((char) strtol(tables.substr(i + 2, 2).c_str(), NULL, 16));
+        i += 3;
+      } else {
+        key.push_back(tables[i]);
+      }
+    }
+    keys.push_back(key);
+    pos = end;
+  }
+  return keys;
+}
+
+
+/// Load the index and filter blocks of every table into the table cache and read each hot range so that its
+/// data blocks are in the block cache.
+void warmUp(DB* native_db, int64_t* tables_warmed, int64_t* bytes_warmed) {
+  leveldb::DB* db = native_db->db;
+
+  // Opening a table reads its index and filter blocks. Seeking to a key in each table opens it. The data blocks
+  // read by the seek are not cached.
+  leveldb::ReadOptions options;
+  options.fill_cache = false;
+  leveldb::Iterator* it = db->NewIterator(options);
+  std::vector<std::string> keys = tableSmallestKeys(db);
+  for (std::vector<std::string>::iterator key = keys.begin(); key != keys.end(); ++key) {
+    it->Seek(*key);
+    *tables_warmed += 1;
+  }
+  delete it;
+
+  it = db->NewIterator(leveldb::ReadOptions());
+  for (size_t i = 0; i < native_db->hot_ranges.size(); i++) {
+    const std::string& gte = native_db->hot_ranges[i].first;
+    const std::string& lt = native_db->hot_ranges[i].second;
+    for (it->Seek(gte); it->Valid(); it->Next()) {
+      leveldb::Slice key = it->key();
+      if (!lt.empty() && key.compare(lt) >= 0) {
+        break;
+      }
+      *bytes_warmed += key.size() + it->value().size();
+    }
+  }
+  delete it;
+}
+
+
+/// Open the db, warm it up if requested and notify all waiting ports.
+void openDB(DB* native_db) {
+    // This function may not take the shared mutex because we take it when waiting for the open to finish.
+    int64_t start = nowMicros();
     leveldb::Options options;
     options.create_if_missing = native_db->create_if_missing;
     options.error_if_exists = native_db->error_if_exists;
     options.block_size = native_db->block_size;
     options.filter_policy = leveldb::NewBloomFilterPolicy(BLOOM_BITS_PER_KEY);
+    options.env = native_db->env;
+
+    // The ttl setting changes the value format so it must match the setting the db was created with.
+    std::string ttl_marker = std::string(native_db->path) + "/" + TTL_MARKER_FILE;
+    bool is_existing = native_db->env->FileExists(std::string(native_db->path) + "/CURRENT");
+    bool is_ttl_marked = native_db->env->FileExists(ttl_marker);
+
+    leveldb::Status status;
+    if (is_existing && is_ttl_marked != native_db->is_ttl) {
+        status = leveldb::Status::InvalidArgument("ttl setting does not match the db");
+    } else if (!is_existing && native_db->create_if_missing) {
+        // Mark a new db before it is created so that a crash can never leave a ttl db without the marker. A marker
+        // without CURRENT is left by a create which failed and is replaced.
+        native_db->env->CreateDir(native_db->path);  // Ignore the error if the directory exists.
+        if (native_db->is_ttl) {
+            status = leveldb::WriteStringToFileSync(native_db->env, "", ttl_marker);
+        } else if (is_ttl_marked) {
+            status = native_db->env->RemoveFile(ttl_marker);
+        }
+    }
+    if (status.ok()) {
+        status = leveldb::DB::Open(options, native_db->path, &native_db->db);
+    }
 
-    leveldb::Status status = leveldb::DB::Open(options, native_db->path, &native_db->db);
+    if (status.ok()) {
+        postOpenProgress(native_db, OPEN_PHASE_OPENED, start, 0, 0);
+    }
+    if (status.ok() && native_db->is_warm_up) {
+        int64_t tables_warmed = 0;
+        int64_t bytes_warmed = 0;
+        warmUp(native_db, &tables_warmed, &bytes_warmed);
+        postOpenProgress(native_db, OPEN_PHASE_WARMED, start, tables_warmed, bytes_warmed);
+    }
 
     // Notify all ports the new status.
     pthread_mutex_lock(&native_db->mutex);
     native_db->open_status = statusToError(status);
 
+    if (status.ok() && native_db->is_ttl && native_db->reap_interval_ms > 0) {
+        int rc = pthread_create(&native_db->reaper_thread, NULL, runReaper, (void*)native_db);
+        assert(rc == 0);
+        native_db->is_reaper_running = true;
+    }
+
     while (!native_db->notify_list.empty()) {
         Dart_Port port = native_db->notify_list.front();
         native_db->notify_list.pop_front();
         Dart_PostInteger(port, native_db->open_status);
     }
+    // The db may be deleted as soon as the mutex is released so it must not be used after this.
+    pthread_cond_broadcast(&native_db->open_cond);
     pthread_mutex_unlock(&native_db->mutex);
+}
+
+
+void* runOpen(void* ptr) {
+    openDB((DB*) ptr);
     return NULL;
 }
 
+
+/// A pool of threads used to open many dbs with bounded concurrency. Threads are started when dbs are queued and
+/// exit when the queue is empty.
+struct OpenPool {
+  pthread_mutex_t mutex;
+  std::deque<DB*> queue;
+  int64_t max_threads;
+  int64_t running_threads;
+  // References are held by the dart object and each running thread.
+  int64_t refcount;
+};
+
+
+void releaseOpenPool(OpenPool* pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->refcount -= 1;
+  bool is_finished = pool->refcount == 0;
+  pthread_mutex_unlock(&pool->mutex);
+
+  if (is_finished) {
+    pthread_mutex_destroy(&pool->mutex);
+    delete pool;
+  }
+}
+
+
+void* runOpenPool(void* ptr) {
+  OpenPool* pool = (OpenPool*) ptr;
+  while (true) {
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->queue.empty()) {
+      pool->running_threads -= 1;
+      pthread_mutex_unlock(&pool->mutex);
+      break;
+    }
+    DB* db = pool->queue.front();
+    pool->queue.pop_front();
+    pthread_mutex_unlock(&pool->mutex);
+
+    openDB(db);
+  }
+  releaseOpenPool(pool);
+  return NULL;
+}
+
+
+void spawnDetached(void* (*function)(void*), void* arg) {
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int rc = pthread_create(&thread, &attr, function, arg);
+  assert(rc == 0);
+  pthread_attr_destroy(&attr);
+}
+
+
+void enqueueOpen(OpenPool* pool, DB* db) {
+  bool is_spawn = false;
+  pthread_mutex_lock(&pool->mutex);
+  pool->queue.push_back(db);
+  if (pool->running_threads < pool->max_threads) {
+    pool->running_threads += 1;
+    pool->refcount += 1;
+    is_spawn = true;
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  if (is_spawn) {
+    spawnDetached(runOpenPool, (void*) pool);
+  }
+}
+
+
 /// Open a db and take a reference to it.
 /// open_port_id will be notified when the db is ready or an error occurs.
-DB* referenceDB(const char *path, bool is_shared, Dart_Port open_port_id, bool create_if_missing, bool error_if_exists, int64_t block_size) {
+/// If pool is not NULL the db is opened by one of the pool threads. Otherwise a thread is spawned to open it.
+DB* referenceDB(const char *path, bool is_shared, Dart_Port open_port_id, bool create_if_missing, bool error_if_exists, int64_t block_size, bool is_ttl, int64_t reap_interval_ms,
+                OpenPool* pool, bool is_warm_up, const std::vector<std::pair<std::string, std::string> >& hot_ranges, Dart_Port progress_port,
+                int64_t compaction_bytes_per_second, bool is_in_memory) {
     DB* db = NULL;
     bool is_new = false;
 
@@ -133,12 +844,29 @@ DB* referenceDB(const char *path, bool is_shared, Dart_Port open_port_id, bool c
         db = new DB();
         db->is_shared = is_shared;
         db->path = strdup(path);
+        db->mem_env = is_in_memory ? leveldb::NewMemEnv(leveldb::Env::Default()) : NULL;
+        db->env = new DBEnv(is_in_memory ? db->mem_env : leveldb::Env::Default(), compaction_bytes_per_second);
         db->refcount = 0;
         db->open_status = 1;
         db->create_if_missing = create_if_missing;
         db->error_if_exists = error_if_exists;
         db->block_size = block_size;
+        db->is_ttl = is_ttl;
+        db->reap_interval_ms = reap_interval_ms;
+        db->is_reaper_running = false;
+        db->is_reaper_stopping = false;
+        db->reap_sweeps = 0;
+        db->reap_keys = 0;
+        db->reap_bytes = 0;
+        db->reap_last_keys = 0;
+        db->reap_last_micros = 0;
+        db->is_warm_up = is_warm_up;
+        db->hot_ranges = hot_ranges;
+        db->progress_port = progress_port;
         pthread_mutex_init(&db->mutex, NULL);
+        pthread_cond_init(&db->open_cond, NULL);
+        pthread_cond_init(&db->reaper_cond, NULL);
+        pthread_rwlock_init(&db->ttl_lock, NULL);
     }
 
     // If the db is shared add it to the map
@@ -149,7 +877,10 @@ DB* referenceDB(const char *path, bool is_shared, Dart_Port open_port_id, bool c
     // If the db is open then just post a reply now. Otherwise add the port to the notify list.
     pthread_mutex_lock(&db->mutex);
     db->refcount += 1;
-    if (db->open_status <= 0) {
+    if (db->is_ttl != is_ttl) {
+        // A shared db must be opened with the same value format by every reference.
+        Dart_PostInteger(open_port_id, -4);
+    } else if (db->open_status <= 0) {
         // The open thread has finished.
         Dart_PostInteger(open_port_id, db->open_status);
     } else {
@@ -158,14 +889,11 @@ DB* referenceDB(const char *path, bool is_shared, Dart_Port open_port_id, bool c
     pthread_mutex_unlock(&db->mutex);
     pthread_mutex_unlock(&shared_mutex);
 
-    // Spawn a thread to open the DB
-    if (is_new) {
-        pthread_attr_t attr;
-        pthread_attr_init(&attr);
-        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-        int rc = pthread_create(&db->thread, &attr, runOpen, (void*)db);
-        assert(rc == 0);
-        pthread_attr_destroy(&attr);
+    // Open the DB on another thread
+    if (is_new && pool != NULL) {
+        enqueueOpen(pool, db);
+    } else if (is_new) {
+        spawnDetached(runOpen, (void*)db);
     }
     return db;
 }
@@ -187,19 +915,33 @@ void unreferenceDB(DB* db) {
         sharedDBs.erase(db->path);
     }
 
+    // Wait for the open to finish. The opening thread does not use the db after setting open_status.
+    while (is_finished && db->open_status > 0) {
+        pthread_cond_wait(&db->open_cond, &db->mutex);
+    }
+
     pthread_mutex_unlock(&db->mutex);
 
     if (is_finished) {
-        // It is possible that unreferenceDB is called before db->thread is initialized if a 2nd thread quickly takes a reference to a
-        // shared db and then drops it. However the initializing thread still has a reference so it is safe to call pthread_join()
-        // if the refcount was 0
-        pthread_join(db->thread, NULL);
+        // The open thread is the only thread which starts the reaper so it is safe to read is_reaper_running now.
+        if (db->is_reaper_running) {
+            pthread_mutex_lock(&db->mutex);
+            db->is_reaper_stopping = true;
+            pthread_cond_signal(&db->reaper_cond);
+            pthread_mutex_unlock(&db->mutex);
+            pthread_join(db->reaper_thread, NULL);
+        }
 
         // The actual closing of the db and its file descriptors must be run whilst
         // the shared lock is taken so that any threads attempting to open the same file will
         // succeed.
         delete db->path;
         delete db->db;
+        delete db->env;
+        delete db->mem_env;
+        pthread_cond_destroy(&db->open_cond);
+        pthread_cond_destroy(&db->reaper_cond);
+        pthread_rwlock_destroy(&db->ttl_lock);
         delete db;
     }
 
@@ -207,6 +949,208 @@ void unreferenceDB(DB* db) {
 }
 
 
+struct Checkpoint {
+  DB* db;
+  std::string dest;
+  Dart_Port port;
+
+  // Progress
+  int64_t files_done;
+  int64_t files_total;
+  int64_t bytes_linked;
+  int64_t bytes_copied;
+};
+
+
+void postCheckpointProgress(Checkpoint* checkpoint) {
+  int64_t progress[] = {checkpoint->files_done, checkpoint->files_total, checkpoint->bytes_linked, checkpoint->bytes_copied};
+  postIntegerList(checkpoint->port, progress, sizeof(progress) / sizeof(progress[0]));
+}
+
+
+/// Copy the current contents of src to dest. Files which are being appended to (e.g. the log) may end in a partial
+/// record which leveldb ignores when recovering.
+leveldb::Status copyFile(leveldb::Env* src_env, const std::string& src, leveldb::Env* dest_env, const std::string& dest, int64_t* bytes_copied) {
+  leveldb::SequentialFile* src_file;
+  leveldb::Status status = src_env->NewSequentialFile(src, &src_file);
+  if (!status.ok()) {
+    return status;
+  }
+  leveldb::WritableFile* dest_file;
+  status = dest_env->NewWritableFile(dest, &dest_file);
+  if (!status.ok()) {
+    delete src_file;
+    return status;
+  }
+
+  const size_t buffer_size = 64 * 1024;
+  char* buffer = new char[buffer_size];
+  while (status.ok()) {
+    leveldb::Slice fragment;
+    status = src_file->Read(buffer_size, &fragment, buffer);
+    if (!status.ok() || fragment.empty()) {
+      break;
+    }
+    status = dest_file->Append(fragment);
+    *bytes_copied += fragment.size();
+  }
+  delete[] buffer;
+
+  if (status.ok()) {
+    status = dest_file->Sync();
+  }
+  if (status.ok()) {
+    status = dest_file->Close();
+  }
+  delete dest_file;
+  delete src_file;
+  return status;
+}
+
+
+/// Checkpoint a table file. Table files are immutable so if the file already exists in the destination with the
+/// same size it is from an earlier checkpoint and is kept. Otherwise the file is hard linked or copied if linking is
+/// not possible (e.g. dest is on a different file system).
+leveldb::Status checkpointTable(leveldb::Env* src_env, const std::string& src, leveldb::Env* dest_env, const std::string& dest, Checkpoint* checkpoint) {
+  uint64_t src_size;
+  leveldb::Status status = src_env->GetFileSize(src, &src_size);
+  if (!status.ok()) {
+    return status;
+  }
+  uint64_t dest_size;
+  if (dest_env->FileExists(dest)) {
+    if (dest_env->GetFileSize(dest, &dest_size).ok() && dest_size == src_size) {
+      return status;
+    }
+    dest_env->RemoveFile(dest);
+  }
+  // Files in an in memory db can only be copied.
+  if (src_env == dest_env && link(src.c_str(), dest.c_str()) == 0) {
+    checkpoint->bytes_linked += src_size;
+    return status;
+  }
+  return copyFile(src_env, src, dest_env, dest, &checkpoint->bytes_copied);
+}
+
+
+/// Remove the files copied under temporary names by a checkpoint which failed.
+void removeStaged(leveldb::Env* dest_env, const std::string& dest_dir, const std::vector<std::string>& staged) {
+  for (std::vector<std::string>::const_iterator it = staged.begin(); it != staged.end(); ++it) {
+    dest_env->RemoveFile(dest_dir + "/" + *it + CHECKPOINT_TMP_SUFFIX);
+  }
+}
+
+
+leveldb::Status runCheckpointFiles(Checkpoint* checkpoint) {
+  DB* db = checkpoint->db;
+  // The db is read through its base env, which is in memory for an in memory db. The checkpoint is always
+  // written to disk.
+  leveldb::Env* src_env = db->env->target();
+  leveldb::Env* dest_env = leveldb::Env::Default();
+  std::string src_dir = db->path;
+  const std::string& dest_dir = checkpoint->dest;
+
+  dest_env->CreateDir(dest_dir);  // Ignore the error if the directory exists.
+
+  // The MANIFEST named by CURRENT is copied before listing the table and log files. Every table and log it
+  // references was created before it was copied and, because file removal is paused, is still in the listing.
+  std::string current;
+  leveldb::Status status = leveldb::ReadFileToString(src_env, src_dir + "/CURRENT", &current);
+  if (!status.ok()) {
+    return status;
+  }
+  if (current.empty() || current[current.size() - 1] != '\n') {
+    return leveldb::Status::Corruption("CURRENT file does not end with newline");
+  }
+  std::string manifest = current.substr(0, current.size() - 1);
+
+  // The MANIFEST and logs usually have the same names as those of an earlier checkpoint in dest. They are copied
+  // under temporary names and only renamed once every file is written so that an earlier checkpoint stays intact
+  // if this one fails.
+  std::vector<std::string> staged;
+  staged.push_back(manifest);
+  status = copyFile(src_env, src_dir + "/" + manifest, dest_env, dest_dir + "/" + manifest + CHECKPOINT_TMP_SUFFIX,
+                    &checkpoint->bytes_copied);
+  if (!status.ok()) {
+    removeStaged(dest_env, dest_dir, staged);
+    return status;
+  }
+
+  std::vector<std::string> children;
+  status = src_env->GetChildren(src_dir, &children);
+  if (!status.ok()) {
+    removeStaged(dest_env, dest_dir, staged);
+    return status;
+  }
+  std::vector<std::string> tables;
+  std::vector<std::string> logs;
+  for (std::vector<std::string>::iterator it = children.begin(); it != children.end(); ++it) {
+    if (hasSuffix(*it, ".ldb") || hasSuffix(*it, ".sst")) {
+      tables.push_back(*it);
+    } else if (hasSuffix(*it, ".log") || *it == TTL_MARKER_FILE) {
+      // The ttl marker is copied with the logs so the checkpoint must be opened with the same ttl setting.
+      logs.push_back(*it);
+    }
+  }
+  checkpoint->files_total = tables.size() + logs.size() + 2;  // + MANIFEST and CURRENT
+  checkpoint->files_done += 1;  // The MANIFEST
+  postCheckpointProgress(checkpoint);
+
+  for (std::vector<std::string>::iterator it = tables.begin(); status.ok() && it != tables.end(); ++it) {
+    status = checkpointTable(src_env, src_dir + "/" + *it, dest_env, dest_dir + "/" + *it, checkpoint);
+    checkpoint->files_done += 1;
+    postCheckpointProgress(checkpoint);
+  }
+
+  // Logs are copied last so that the checkpoint contains every write up to this point.
+  for (std::vector<std::string>::iterator it = logs.begin(); status.ok() && it != logs.end(); ++it) {
+    staged.push_back(*it);
+    status = copyFile(src_env, src_dir + "/" + *it, dest_env, dest_dir + "/" + *it + CHECKPOINT_TMP_SUFFIX,
+                      &checkpoint->bytes_copied);
+    checkpoint->files_done += 1;
+    postCheckpointProgress(checkpoint);
+  }
+
+  std::string current_tmp = dest_dir + "/CURRENT" + CHECKPOINT_TMP_SUFFIX;
+  if (status.ok()) {
+    status = leveldb::WriteStringToFileSync(dest_env, current, current_tmp);
+  }
+  if (!status.ok()) {
+    removeStaged(dest_env, dest_dir, staged);
+    dest_env->RemoveFile(current_tmp);
+    return status;
+  }
+
+  // Every file is written. Move the staged files into place and then CURRENT, which is renamed last so that it
+  // never names a MANIFEST which is not complete.
+  for (std::vector<std::string>::iterator it = staged.begin(); status.ok() && it != staged.end(); ++it) {
+    status = dest_env->RenameFile(dest_dir + "/" + *it + CHECKPOINT_TMP_SUFFIX, dest_dir + "/" + *it);
+  }
+  if (status.ok()) {
+    status = dest_env->RenameFile(current_tmp, dest_dir + "/CURRENT");
+  }
+  checkpoint->files_done += 1;
+  postCheckpointProgress(checkpoint);
+  return status;
+}
+
+
+void* runCheckpoint(void* ptr) {
+  Checkpoint* checkpoint = (Checkpoint*) ptr;
+  DB* db = checkpoint->db;
+
+  db->env->PauseFileRemoval();
+  leveldb::Status status = runCheckpointFiles(checkpoint);
+  db->env->ResumeFileRemoval();
+
+  Dart_PostInteger(checkpoint->port, statusToError(status));
+
+  unreferenceDB(db);
+  delete checkpoint;
+  return NULL;
+}
+
+
 struct NativeIterator;
 
 
@@ -238,6 +1182,22 @@ struct NativeIterator {
 };
 
 
+/// Merges the iterators of several dbs into a single key ordered iteration.
+struct NativeMergeIterator {
+  // One iterator per db. Each iterator is registered with its db so it is finalized if that db is closed.
+  std::vector<NativeIterator*> sources;
+  // Indexes of the sources which have a current item, ordered as a heap by (key, index).
+  std::vector<size_t> heap;
+  bool is_started;
+  bool is_finalized;
+  // If true every item is returned when a key exists in several dbs. Otherwise only the first db's item is returned.
+  bool is_emit_all;
+
+  int64_t limit;
+  int64_t count;
+};
+
+
 /**
  * Finalize the iterator.
  */
@@ -280,29 +1240,96 @@ static void NativeDBFinalizer(void* isolate_callback_data, void* peer) {
     }
     delete native_db->iterators;
 
-    delete native_db;
-}
+    delete native_db;
+}
+
+
+static void mergeIteratorFinalize(NativeMergeIterator *merge_iterator) {
+  if (merge_iterator->is_finalized) {
+    return;
+  }
+  merge_iterator->is_finalized = true;
+  merge_iterator->heap.clear();
+  for (size_t i = 0; i < merge_iterator->sources.size(); i++) {
+    iteratorFinalize(merge_iterator->sources[i]);
+  }
+}
+
+
+Dart_Handle HandleError(Dart_Handle handle) {
+  if (Dart_IsError(handle)) {
+    Dart_PropagateError(handle);
+  }
+  return handle;
+}
+
+
+/**
+ * Finalizer called when the dart instance is not reachable.
+ * */
+static void NativeIteratorFinalizer(void* isolate_callback_data, void* peer) {
+  NativeIterator* it_ref = (NativeIterator*) peer;
+  iteratorFinalize(it_ref);
+  delete it_ref;
+}
+
+
+/**
+ * Finalizer called when the dart instance is not reachable.
+ * */
+static void NativeMergeIteratorFinalizer(void* isolate_callback_data, void* peer) {
+  NativeMergeIterator* merge_iterator = (NativeMergeIterator*) peer;
+  mergeIteratorFinalize(merge_iterator);
+  for (size_t i = 0; i < merge_iterator->sources.size(); i++) {
+    delete merge_iterator->sources[i];
+  }
+  delete merge_iterator;
+}
+
+
+/**
+ * Finalizer called when the dart open pool is not reachable.
+ * */
+static void OpenPoolFinalizer(void* isolate_callback_data, void* peer) {
+    releaseOpenPool((OpenPool*) peer);
+}
+
+
+void openPoolNew(Dart_NativeArguments arguments) {  // (this, int concurrency)
+    Dart_EnterScope();
+
+    OpenPool* pool = new OpenPool();
+    pthread_mutex_init(&pool->mutex, NULL);
+    pool->running_threads = 0;
+    pool->refcount = 1;
+    Dart_GetNativeIntegerArgument(arguments, 1, &pool->max_threads);
 
+    Dart_Handle arg0 = Dart_GetNativeArgument(arguments, 0);
+    Dart_SetNativeInstanceField(arg0, 0, (intptr_t) pool);
+    Dart_NewWeakPersistentHandle(arg0, (void*) pool, sizeof(OpenPool) /* external_allocation_size */, OpenPoolFinalizer);
 
-Dart_Handle HandleError(Dart_Handle handle) {
-  if (Dart_IsError(handle)) {
-    Dart_PropagateError(handle);
-  }
-  return handle;
+    Dart_SetReturnValue(arguments, Dart_Null());
+    Dart_ExitScope();
 }
 
 
-/**
- * Finalizer called when the dart instance is not reachable.
- * */
-static void NativeIteratorFinalizer(void* isolate_callback_data, void* peer) {
-  NativeIterator* it_ref = (NativeIterator*) peer;
-  iteratorFinalize(it_ref);
-  delete it_ref;
+// Copy a nullable Uint8List. null is returned as an empty string.
+std::string typedDataToString(Dart_Handle handle) {
+    if (Dart_IsNull(handle)) {
+        return std::string();
+    }
+    Dart_TypedData_Type typed_data_type;
+    char *data;
+    intptr_t len;
+    Dart_TypedDataAcquireData(handle, &typed_data_type, (void**)&data, &len);
+    assert(typed_data_type == Dart_TypedData_kUint8);
+    std::string result(data, len);
+    Dart_TypedDataReleaseData(handle);
+    return result;
 }
 
 
-void dbOpen(Dart_NativeArguments arguments) {  // (bool shared, SendPort port, String path, int blockSize, bool create_if_missing, bool error_if_exists)
+void dbOpen(Dart_NativeArguments arguments) {  // (bool shared, SendPort port, String path, int blockSize, bool create_if_missing, bool error_if_exists, bool ttl, int reap_interval_ms, OpenPool? pool, bool warm_up, List<Uint8List?> hot_ranges, bool report_progress, int compaction_bytes_per_second, bool in_memory)
     Dart_EnterScope();
 
     NativeDB* native_db = new NativeDB();
@@ -325,7 +1352,41 @@ void dbOpen(Dart_NativeArguments arguments) {  // (bool shared, SendPort port, S
     Dart_GetNativeBooleanArgument(arguments, 5, &create_if_missing);
     Dart_GetNativeBooleanArgument(arguments, 6, &error_if_exists);
 
-    native_db->db = referenceDB(path, is_shared, port_id, create_if_missing, error_if_exists, 1024);
+    bool is_ttl;
+    int64_t reap_interval_ms;
+    Dart_GetNativeBooleanArgument(arguments, 7, &is_ttl);
+    Dart_GetNativeIntegerArgument(arguments, 8, &reap_interval_ms);
+
+    OpenPool* pool = NULL;
+    Dart_Handle arg9 = Dart_GetNativeArgument(arguments, 9);
+    if (!Dart_IsNull(arg9)) {
+        Dart_GetNativeInstanceField(arg9, 0, (intptr_t*) &pool);
+    }
+
+    bool is_warm_up;
+    Dart_GetNativeBooleanArgument(arguments, 10, &is_warm_up);
+
+    // Hot ranges are passed as a flat list of [gte, lt] pairs.
+    std::vector<std::pair<std::string, std::string> > hot_ranges;
+    Dart_Handle arg11 = Dart_GetNativeArgument(arguments, 11);
+    intptr_t hot_ranges_len;
+    Dart_ListLength(arg11, &hot_ranges_len);
+    for (intptr_t i = 0; i + 1 < hot_ranges_len; i += 2) {
+        hot_ranges.push_back(std::make_pair(typedDataToString(Dart_ListGetAt(arg11, i)),
+                                            typedDataToString(Dart_ListGetAt(arg11, i + 1))));
+    }
+
+    bool is_report_progress;
+    Dart_GetNativeBooleanArgument(arguments, 12, &is_report_progress);
+
+    int64_t compaction_bytes_per_second;
+    bool is_in_memory;
+    Dart_GetNativeIntegerArgument(arguments, 13, &compaction_bytes_per_second);
+    Dart_GetNativeBooleanArgument(arguments, 14, &is_in_memory);
+
+    native_db->db = referenceDB(path, is_shared, port_id, create_if_missing, error_if_exists, 1024, is_ttl, reap_interval_ms,
+                                pool, is_warm_up, hot_ranges, is_report_progress ? port_id : ILLEGAL_PORT,
+                                compaction_bytes_per_second, is_in_memory);
     native_db->iterators = new std::list<NativeIterator*>();
 
     Dart_Handle arg0 = Dart_GetNativeArgument(arguments, 0);
@@ -358,6 +1419,8 @@ void maybeThrowStatus(leveldb::Status status) {
   Dart_Handle klass;
   if (status.IsCorruption()) {
     klass = Dart_GetNonNullableType(library, Dart_NewStringFromCString("LevelCorruptionError"), 0, NULL);
+  } else if (status.IsInvalidArgument()) {
+    klass = Dart_GetNonNullableType(library, Dart_NewStringFromCString("LevelInvalidArgumentError"), 0, NULL);
   } else {
     klass = Dart_GetNonNullableType(library, Dart_NewStringFromCString("LevelIOError"), 0, NULL);
   }
@@ -366,66 +1429,114 @@ void maybeThrowStatus(leveldb::Status status) {
 }
 
 
-void syncNew(Dart_NativeArguments arguments) {  // (this, db, limit, fillCache, gt, is_gt_closed, lt, is_lt_closed)
-  Dart_EnterScope();
+void dbCheckpoint(Dart_NativeArguments arguments) {  // (this, SendPort port, String dest)
+    Dart_EnterScope();
 
-  NativeDB *native_db;
-  Dart_Handle arg1 = Dart_GetNativeArgument(arguments, 1);
-  Dart_GetNativeInstanceField(arg1, 0, (intptr_t*) &native_db);
+    NativeDB *native_db;
+    Dart_Handle arg0 = Dart_GetNativeArgument(arguments, 0);
+    Dart_GetNativeInstanceField(arg0, 0, (intptr_t*) &native_db);
 
-  if (native_db->db == NULL) {
-    throwClosedException();
-    assert(false); // Not reached
+    if (native_db->db == NULL) {
+        throwClosedException();
+        assert(false); // Not reached
+    }
+
+    Checkpoint* checkpoint = new Checkpoint();
+    checkpoint->db = native_db->db;
+    checkpoint->files_done = 0;
+    checkpoint->files_total = 0;
+    checkpoint->bytes_linked = 0;
+    checkpoint->bytes_copied = 0;
+
+    Dart_Handle arg1 = Dart_GetNativeArgument(arguments, 1);
+    Dart_SendPortGetId(arg1, &checkpoint->port);
+
+    const char* dest;
+    Dart_Handle arg2 = Dart_GetNativeArgument(arguments, 2);
+    Dart_StringToCString(arg2, &dest);
+    checkpoint->dest = dest;
+
+    // The checkpoint thread holds its own reference so that the db stays open if it is closed by every isolate
+    // before the checkpoint finishes. The caller holds a reference so the refcount cannot be 0 here.
+    pthread_mutex_lock(&checkpoint->db->mutex);
+    checkpoint->db->refcount += 1;
+    pthread_mutex_unlock(&checkpoint->db->mutex);
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(&thread, &attr, runCheckpoint, (void*)checkpoint);
+    assert(rc == 0);
+    pthread_attr_destroy(&attr);
+
+    Dart_SetReturnValue(arguments, Dart_Null());
+    Dart_ExitScope();
+}
+
+
+/// Copy an iterator bound from a Uint8List. A null bound is stored as NULL with length 0.
+void copyBound(Dart_Handle handle, uint8_t** bound, int64_t* bound_len) {
+  if (Dart_IsNull(handle)) {
+    *bound = NULL;
+    *bound_len = 0;
+    return;
   }
+  Dart_TypedData_Type typed_data_type = Dart_GetTypeOfTypedData(handle);
+  assert(typed_data_type == Dart_TypedData_kUint8);
+
+  char *data;
+  intptr_t len;
+  Dart_TypedDataAcquireData(handle, &typed_data_type, (void**)&data, &len);
+  *bound_len = len;
+  *bound = (uint8_t*) malloc(len);
+  memcpy(*bound, data, len);
+  Dart_TypedDataReleaseData(handle);
+}
 
+
+NativeIterator* newNativeIterator(NativeDB* native_db, int64_t limit, bool is_fill_cache, Dart_Handle gt, bool is_gt_closed, Dart_Handle lt, bool is_lt_closed) {
   NativeIterator* it_ref = new NativeIterator();
   it_ref->native_db = native_db;
   it_ref->is_finalized = false;
   it_ref->iterator = NULL;
   it_ref->count = 0;
+  it_ref->limit = limit;
+  it_ref->is_fill_cache = is_fill_cache;
+  copyBound(gt, &it_ref->gt, &it_ref->gt_len);
+  copyBound(lt, &it_ref->lt, &it_ref->lt_len);
+  it_ref->is_gt_closed = is_gt_closed;
+  it_ref->is_lt_closed = is_lt_closed;
+  return it_ref;
+}
 
-  Dart_Handle arg0 = Dart_GetNativeArgument(arguments, 0);
-  Dart_SetNativeInstanceField(arg0, 0, (intptr_t) it_ref);
 
-  Dart_GetNativeIntegerArgument(arguments, 2, &it_ref->limit);
-  Dart_GetNativeBooleanArgument(arguments, 3, &it_ref->is_fill_cache);
+void syncNew(Dart_NativeArguments arguments) {  // (this, db, limit, fillCache, gt, is_gt_closed, lt, is_lt_closed)
+  Dart_EnterScope();
 
-  Dart_Handle arg5 = Dart_GetNativeArgument(arguments, 4);
-  if (Dart_IsNull(arg5)) {
-    it_ref->gt = NULL;
-    it_ref->gt_len = 0;
-  } else {
-    Dart_TypedData_Type typed_data_type = Dart_GetTypeOfTypedData(arg5);
-    assert(typed_data_type == Dart_TypedData_kUint8);
+  NativeDB *native_db;
+  Dart_Handle arg1 = Dart_GetNativeArgument(arguments, 1);
+  Dart_GetNativeInstanceField(arg1, 0, (intptr_t*) &native_db);
 
-    char *data;
-    intptr_t len;
-    Dart_TypedDataAcquireData(arg5, &typed_data_type, (void**)&data, &len);
-    it_ref->gt_len = len;
-    it_ref->gt = (uint8_t*) malloc(len);
-    memcpy(it_ref->gt, data, len);
-    Dart_TypedDataReleaseData(arg5);
+  if (native_db->db == NULL) {
+    throwClosedException();
+    assert(false); // Not reached
   }
 
-  Dart_Handle arg6 = Dart_GetNativeArgument(arguments, 6);
-  if (Dart_IsNull(arg6)) {
-    it_ref->lt = NULL;
-    it_ref->lt_len = 0;
-  } else {
-    Dart_TypedData_Type typed_data_type = Dart_GetTypeOfTypedData(arg6);
-    assert(typed_data_type != Dart_TypedData_kInvalid);
+  int64_t limit;
+  bool is_fill_cache;
+  bool is_gt_closed;
+  bool is_lt_closed;
+  Dart_GetNativeIntegerArgument(arguments, 2, &limit);
+  Dart_GetNativeBooleanArgument(arguments, 3, &is_fill_cache);
+  Dart_GetNativeBooleanArgument(arguments, 5, &is_gt_closed);
+  Dart_GetNativeBooleanArgument(arguments, 7, &is_lt_closed);
 
-    char *data;
-    intptr_t len;
-    Dart_TypedDataAcquireData(arg6, &typed_data_type, (void**)&data, &len);
-    it_ref->lt_len = len;
-    it_ref->lt = (uint8_t*) malloc(len);
-    memcpy(it_ref->lt, data, len);
-    Dart_TypedDataReleaseData(arg6);
-  }
+  NativeIterator* it_ref = newNativeIterator(native_db, limit, is_fill_cache,
+      Dart_GetNativeArgument(arguments, 4), is_gt_closed, Dart_GetNativeArgument(arguments, 6), is_lt_closed);
 
-  Dart_GetNativeBooleanArgument(arguments, 5, &it_ref->is_gt_closed);
-  Dart_GetNativeBooleanArgument(arguments, 7, &it_ref->is_lt_closed);
+  Dart_Handle arg0 = Dart_GetNativeArgument(arguments, 0);
+  Dart_SetNativeInstanceField(arg0, 0, (intptr_t) it_ref);
 
   // We just pass the directly allocated size of the iterator here. The iterator holds a lot of other data in
   // memory when it mmaps the files but I'm not sure how to account for it.
@@ -444,6 +1555,102 @@ uint32_t increaseToMultipleOf4(uint32_t v) {
 }
 
 
+/// Create the leveldb iterator and perform the initial seek.
+void iteratorStart(NativeIterator* native_iterator) {
+  NativeDB *native_db = native_iterator->native_db;
+
+  leveldb::ReadOptions options;
+  options.fill_cache = native_iterator->is_fill_cache;
+  leveldb::Iterator* it = native_db->db->db->NewIterator(options);
+
+  native_iterator->iterator = it;
+  // Add the iterator to the db list. This is so we know to finalize it before finalizing the db.
+  native_db->iterators->push_back(native_iterator);
+
+  if (native_iterator->gt_len > 0) {
+    leveldb::Slice start_slice = leveldb::Slice((char*)native_iterator->gt, native_iterator->gt_len);
+    it->Seek(start_slice);
+
+    if (!native_iterator->is_gt_closed && it->Valid()) {
+    // If we are pointing at start_slice and not inclusive then we need to advance by 1
+    leveldb::Slice key = it->key();
+      if (key.compare(start_slice) == 0) {
+        it->Next();
+      }
+    }
+  } else {
+    it->SeekToFirst();
+  }
+}
+
+
+/// Read the current key and value of a started iterator. Expired values in a ttl db are skipped.
+/// Returns false if the iterator is at the end of the db or has passed the end of its range.
+bool iteratorCurrent(NativeIterator* native_iterator, int64_t now, leveldb::Slice* key, leveldb::Slice* value) {
+  if (native_iterator->is_finalized) {
+    return false;
+  }
+
+  leveldb::Iterator* it = native_iterator->iterator;
+  leveldb::Slice end_slice = leveldb::Slice((char*)native_iterator->lt, native_iterator->lt_len);
+  bool is_ttl = native_iterator->native_db->db->is_ttl;
+
+  while (it->Valid()) {
+    *key = it->key();
+    *value = it->value();
+
+    // Check if key is equal to end slice
+    if (native_iterator->lt_len > 0) {
+      int cmp = key->compare(end_slice);
+      if (cmp == 0 && !native_iterator->is_lt_closed) {  // key == end_slice and not closed
+        return false;
+      }
+      if (cmp > 0) { // key > end_slice
+        return false;
+      }
+    }
+
+    if (!is_ttl) {
+      return true;
+    }
+
+    if (value->size() < TTL_HEADER_SIZE) {
+      iteratorFinalize(native_iterator);
+      maybeThrowStatus(leveldb::Status::Corruption("Value is missing ttl header"));
+      assert(false); // Not reached
+    }
+
+    // Skip expired values without copying them to dart.
+    if (!isExpired(*value, now)) {
+      value->remove_prefix(TTL_HEADER_SIZE);
+      return true;
+    }
+    it->Next();
+  }
+  return false;
+}
+
+
+/// Copy key and value into same buffer.
+/// Align the value array to a multiple of 4 bytes so the offset of the view in dart is a multiple of 4.
+Dart_Handle newItem(const leveldb::Slice& key, const leveldb::Slice& value) {
+  uint32_t key_size_mult_4 = increaseToMultipleOf4(key.size());
+  Dart_Handle result = Dart_NewTypedData(Dart_TypedData_kUint8, key_size_mult_4 + value.size() + 4);
+  uint8_t *data;
+  intptr_t len;
+  Dart_TypedData_Type t;
+  Dart_TypedDataAcquireData(result, &t, (void**)&data, &len);
+  data[0] = key.size() & 0xFF;
+  data[1] = (key.size() >> 8) & 0xFF;
+  data[2] = key_size_mult_4 & 0xFF;
+  data[3] = (key_size_mult_4 >> 8) & 0xFF;
+  memcpy(data + 4, key.data(), key.size());
+  memcpy(data + 4 + key_size_mult_4, value.data(), value.size());
+  Dart_TypedDataReleaseData(result);
+  return result;
+}
+
+
 void syncNext(Dart_NativeArguments arguments) {  // (this)
   Dart_EnterScope();
 
@@ -452,7 +1659,6 @@ void syncNext(Dart_NativeArguments arguments) {  // (this)
   Dart_GetNativeInstanceField(arg0, 0, (intptr_t*) &native_iterator);
 
   NativeDB *native_db = native_iterator->native_db;
-  leveldb::Iterator* it = native_iterator->iterator;
 
   if (native_db->db == NULL) {
     throwClosedException();
@@ -460,83 +1666,175 @@ void syncNext(Dart_NativeArguments arguments) {  // (this)
   }
 
   // If it is NULL we need to create the iterator and perform the initial seek.
-  if (!native_iterator->is_finalized && it == NULL) {
-    leveldb::ReadOptions options;
-    options.fill_cache = native_iterator->is_fill_cache;
-    it = native_db->db->db->NewIterator(options);
+  if (!native_iterator->is_finalized && native_iterator->iterator == NULL) {
+    iteratorStart(native_iterator);
+  }
 
-    native_iterator->iterator = it;
-    // Add the iterator to the db list. This is so we know to finalize it before finalizing the db.
-    native_db->iterators->push_back(native_iterator);
+  bool is_limit_reached = native_iterator->limit >= 0 && native_iterator->count >= native_iterator->limit;
+  int64_t now = native_db->db->is_ttl ? nowMillis() : 0;
 
-    if (native_iterator->gt_len > 0) {
-      leveldb::Slice start_slice = leveldb::Slice((char*)native_iterator->gt, native_iterator->gt_len);
-      it->Seek(start_slice);
+  leveldb::Slice key;
+  leveldb::Slice value;
+  bool is_valid = iteratorCurrent(native_iterator, now, &key, &value);
 
-      if (!native_iterator->is_gt_closed && it->Valid()) {
-      // If we are pointing at start_slice and not inclusive then we need to advance by 1
-      leveldb::Slice key = it->key();
-        if (key.compare(start_slice) == 0) {
-          it->Next();
-        }
-      }
-    } else {
-      it->SeekToFirst();
+  Dart_Handle result = Dart_Null();
+
+  if (!is_valid || is_limit_reached) {
+    // Iteration is finished. Any subsequent calls to syncNext() will return null so we can finalize the iterator
+    // here.
+    iteratorFinalize(native_iterator);
+  } else {
+    result = newItem(key, value);
+    native_iterator->count += 1;
+    native_iterator->iterator->Next();
+  }
+
+  Dart_SetReturnValue(arguments, result);
+  Dart_ExitScope();
+}
+
+
+/// Heap comparator which puts the source with the smallest current key (then the smallest index) at the front.
+struct MergeHeapCompare {
+  NativeMergeIterator* merge_iterator;
+
+  bool operator()(size_t a, size_t b) const {
+    int cmp = merge_iterator->sources[a]->iterator->key().compare(merge_iterator->sources[b]->iterator->key());
+    if (cmp != 0) {
+      return cmp > 0;
     }
+    return a > b;
   }
+};
 
-  leveldb::Slice end_slice = leveldb::Slice((char*)native_iterator->lt, native_iterator->lt_len);
-  bool is_valid = false;
-  bool is_limit_reached = native_iterator->limit >= 0 && native_iterator->count >= native_iterator->limit;
-  bool is_query_limit_reached = false;
 
+/// Push the source onto the heap if it has a current item. Otherwise the source is finished and is finalized.
+void mergePushSource(NativeMergeIterator* merge_iterator, size_t index, int64_t now) {
+  NativeIterator* source = merge_iterator->sources[index];
   leveldb::Slice key;
   leveldb::Slice value;
-  if (!native_iterator->is_finalized) {
-    is_valid = it->Valid();
+  if (iteratorCurrent(source, now, &key, &value)) {
+    merge_iterator->heap.push_back(index);
+    std::push_heap(merge_iterator->heap.begin(), merge_iterator->heap.end(), MergeHeapCompare{merge_iterator});
+  } else {
+    iteratorFinalize(source);
   }
+}
 
-  if (is_valid) {
-    key = it->key();
-    value = it->value();
 
-    // Check if key is equal to end slice
-    if (native_iterator->lt_len > 0) {
-      int cmp = key.compare(end_slice);
-      if (cmp == 0 && !native_iterator->is_lt_closed) {  // key == end_slice and not closed
-        is_query_limit_reached = true;
-      }
-      if (cmp > 0) { // key > end_slice
-        is_query_limit_reached = true;
-      }
+size_t mergePopSource(NativeMergeIterator* merge_iterator) {
+  std::pop_heap(merge_iterator->heap.begin(), merge_iterator->heap.end(), MergeHeapCompare{merge_iterator});
+  size_t index = merge_iterator->heap.back();
+  merge_iterator->heap.pop_back();
+  return index;
+}
+
+
+void syncMergeNew(Dart_NativeArguments arguments) {  // (this, dbs, limit, fillCache, gt, is_gt_closed, lt, is_lt_closed, emit_all)
+  Dart_EnterScope();
+
+  Dart_Handle arg1 = Dart_GetNativeArgument(arguments, 1);
+  intptr_t db_count;
+  Dart_ListLength(arg1, &db_count);
+
+  std::vector<NativeDB*> native_dbs;
+  for (intptr_t i = 0; i < db_count; i++) {
+    NativeDB *native_db;
+    Dart_GetNativeInstanceField(Dart_ListGetAt(arg1, i), 0, (intptr_t*) &native_db);
+    if (native_db->db == NULL) {
+      throwClosedException();
+      assert(false); // Not reached
+    }
+    native_dbs.push_back(native_db);
+  }
+
+  NativeMergeIterator* merge_iterator = new NativeMergeIterator();
+  merge_iterator->is_started = false;
+  merge_iterator->is_finalized = false;
+  merge_iterator->count = 0;
+
+  bool is_fill_cache;
+  bool is_gt_closed;
+  bool is_lt_closed;
+  Dart_GetNativeIntegerArgument(arguments, 2, &merge_iterator->limit);
+  Dart_GetNativeBooleanArgument(arguments, 3, &is_fill_cache);
+  Dart_GetNativeBooleanArgument(arguments, 5, &is_gt_closed);
+  Dart_GetNativeBooleanArgument(arguments, 7, &is_lt_closed);
+  Dart_GetNativeBooleanArgument(arguments, 8, &merge_iterator->is_emit_all);
+
+  // The limit applies to the merged iteration so the sources are unlimited.
+  for (size_t i = 0; i < native_dbs.size(); i++) {
+    merge_iterator->sources.push_back(newNativeIterator(native_dbs[i], -1, is_fill_cache,
+        Dart_GetNativeArgument(arguments, 4), is_gt_closed, Dart_GetNativeArgument(arguments, 6), is_lt_closed));
+  }
+
+  Dart_Handle arg0 = Dart_GetNativeArgument(arguments, 0);
+  Dart_SetNativeInstanceField(arg0, 0, (intptr_t) merge_iterator);
+
+  // As with syncNew the memory held by the leveldb iterators is not accounted for.
+  Dart_NewWeakPersistentHandle(arg0, (void*) merge_iterator,
+      /* external_allocation_size */ sizeof(NativeMergeIterator) + native_dbs.size() * sizeof(NativeIterator), NativeMergeIteratorFinalizer);
+
+  Dart_SetReturnValue(arguments, Dart_Null());
+  Dart_ExitScope();
+}
+
+
+void syncMergeNext(Dart_NativeArguments arguments) {  // (this)
+  Dart_EnterScope();
+
+  NativeMergeIterator *merge_iterator;
+  Dart_Handle arg0 = Dart_GetNativeArgument(arguments, 0);
+  Dart_GetNativeInstanceField(arg0, 0, (intptr_t*) &merge_iterator);
+
+  bool is_ttl = false;
+  for (size_t i = 0; i < merge_iterator->sources.size(); i++) {
+    NativeDB *native_db = merge_iterator->sources[i]->native_db;
+    if (native_db->db == NULL) {
+      throwClosedException();
+      assert(false); // Not reached
     }
+    is_ttl = is_ttl || native_db->db->is_ttl;
   }
+  int64_t now = is_ttl ? nowMillis() : 0;
+
+  if (!merge_iterator->is_finalized && !merge_iterator->is_started) {
+    merge_iterator->is_started = true;
+    for (size_t i = 0; i < merge_iterator->sources.size(); i++) {
+      iteratorStart(merge_iterator->sources[i]);
+      mergePushSource(merge_iterator, i, now);
+    }
+  }
+
+  bool is_limit_reached = merge_iterator->limit >= 0 && merge_iterator->count >= merge_iterator->limit;
 
   Dart_Handle result = Dart_Null();
 
-  if (!is_valid || is_query_limit_reached || is_limit_reached) {
-    // Iteration is finished. Any subsequent calls to syncNext() will return null so we can finalize the iterator
-    // here.
-    iteratorFinalize(native_iterator);
+  if (merge_iterator->heap.empty() || is_limit_reached) {
+    mergeIteratorFinalize(merge_iterator);
   } else {
-    // Copy key and value into same buffer.
-    // Align the value array to a multiple of 4 bytes so the offset of the view in dart is a multiple of 4.
-    uint32_t key_size_mult_4 = increaseToMultipleOf4(key.size());
-    result = Dart_NewTypedData(Dart_TypedData_kUint8, key_size_mult_4 + value.size() + 4);
-    uint8_t *data;
-    intptr_t len;
-    Dart_TypedData_Type t;
-    Dart_TypedDataAcquireData(result, &t, (void**)&data, &len);
-    data[0] = key.size() & 0xFF;
-    data[1] = (key.size() >> 8) & 0xFF;
-    data[2] = key_size_mult_4 & 0xFF;
-    data[3] = (key_size_mult_4 >> 8) & 0xFF;
-    memcpy(data + 4, key.data(), key.size());
-    memcpy(data + 4 + key_size_mult_4, value.data(), value.size());
-    Dart_TypedDataReleaseData(result);
+    size_t index = mergePopSource(merge_iterator);
+    NativeIterator* source = merge_iterator->sources[index];
+
+    leveldb::Slice key;
+    leveldb::Slice value;
+    iteratorCurrent(source, now, &key, &value);
+    result = newItem(key, value);
+    merge_iterator->count += 1;
+
+    // Skip the same key in the other dbs. They are at the front of the heap because ties are ordered by index.
+    // This is done before source moves on so that key still refers to its current item.
+    if (!merge_iterator->is_emit_all) {
+      while (!merge_iterator->heap.empty() &&
+             merge_iterator->sources[merge_iterator->heap.front()]->iterator->key().compare(key) == 0) {
+        size_t duplicate = mergePopSource(merge_iterator);
+        merge_iterator->sources[duplicate]->iterator->Next();
+        mergePushSource(merge_iterator, duplicate, now);
+      }
+    }
 
-    native_iterator->count += 1;
-    it->Next();
+    source->iterator->Next();
+    mergePushSource(merge_iterator, index, now);
   }
 
   Dart_SetReturnValue(arguments, result);
@@ -570,14 +1868,26 @@ void syncGet(Dart_NativeArguments arguments) {  // (this, key)
   leveldb::Status status = native_db->db->db->Get(leveldb::ReadOptions(), key, &value);
   Dart_TypedDataReleaseData(arg1);
 
+  // Strip the ttl header. Expired values are reported as not found.
+  size_t offset = 0;
+  if (status.ok() && native_db->db->is_ttl) {
+    if (value.size() < TTL_HEADER_SIZE) {
+      status = leveldb::Status::Corruption("Value is missing ttl header");
+    } else if (isExpired(value, nowMillis())) {
+      status = leveldb::Status::NotFound("Value has expired");
+    } else {
+      offset = TTL_HEADER_SIZE;
+    }
+  }
+
   Dart_Handle result;
   if (status.IsNotFound()) {
     result = Dart_Null();
   } else if (status.ok()) {
-    result = Dart_NewTypedData(Dart_TypedData_kUint8, value.size());
+    result = Dart_NewTypedData(Dart_TypedData_kUint8, value.size() - offset);
     Dart_TypedData_Type t;
     Dart_TypedDataAcquireData(result, &t, (void**)&data, &len);
-    memcpy(data, value.data(), value.size());
+    memcpy(data, value.data() + offset, value.size() - offset);
     Dart_TypedDataReleaseData(result);
   } else {
     maybeThrowStatus(status);
@@ -589,7 +1899,7 @@ void syncGet(Dart_NativeArguments arguments) {  // (this, key)
 }
 
 
-void syncPut(Dart_NativeArguments arguments) {  // (this, key, value, sync)
+void syncPut(Dart_NativeArguments arguments) {  // (this, key, value, sync, has_ttl, ttl_ms)
   Dart_EnterScope();
 
   NativeDB *native_db;
@@ -610,6 +1920,17 @@ void syncPut(Dart_NativeArguments arguments) {  // (this, key, value, sync)
   bool is_sync;
   Dart_GetNativeBooleanArgument(arguments, 3, &is_sync);
 
+  bool has_ttl;
+  Dart_GetNativeBooleanArgument(arguments, 4, &has_ttl);
+
+  int64_t ttl_ms;
+  Dart_GetNativeIntegerArgument(arguments, 5, &ttl_ms);
+
+  if (has_ttl && !native_db->db->is_ttl) {
+    maybeThrowStatus(leveldb::Status::InvalidArgument("ttl requires a db opened with ttl enabled"));
+    assert(false); // Not reached
+  }
+
   char *data1, *data2;
   intptr_t len1, len2;
   Dart_TypedDataAcquireData(arg1, &typed_data_type1, (void**)&data1, &len1);
@@ -624,7 +1945,20 @@ void syncPut(Dart_NativeArguments arguments) {  // (this, key, value, sync)
   leveldb::WriteOptions options;
   options.sync = is_sync;
 
-  leveldb::Status status = native_db->db->db->Put(options, key, value);
+  leveldb::Status status;
+  if (native_db->db->is_ttl) {
+    std::string ttl_value;
+    ttl_value.resize(TTL_HEADER_SIZE);
+    // A ttl <= 0 gives an expiry time which has already passed. It must not become 0 which never expires.
+    encodeExpiry(&ttl_value[0], has_ttl ? std::max<int64_t>(nowMillis() + ttl_ms, 1) : 0);
+    ttl_value.append(value.data(), value.size());
+
+    pthread_rwlock_rdlock(&native_db->db->ttl_lock);
+    status = native_db->db->db->Put(options, key, ttl_value);
+    pthread_rwlock_unlock(&native_db->db->ttl_lock);
+  } else {
+    status = native_db->db->db->Put(options, key, value);
+  }
   
   Dart_TypedDataReleaseData(arg1);
   Dart_TypedDataReleaseData(arg2);
@@ -667,6 +2001,60 @@ void syncDelete(Dart_NativeArguments arguments) {  // (this, key)
 }
 
 
+void syncTtlStats(Dart_NativeArguments arguments) {  // (this)
+  Dart_EnterScope();
+
+  NativeDB *native_db;
+  Dart_Handle arg0 = Dart_GetNativeArgument(arguments, 0);
+  Dart_GetNativeInstanceField(arg0, 0, (intptr_t*) &native_db);
+
+  if (native_db->db == NULL) {
+    throwClosedException();
+    assert(false); // Not reached
+  }
+
+  DB* db = native_db->db;
+  pthread_mutex_lock(&db->mutex);
+  int64_t stats[] = {db->reap_sweeps, db->reap_keys, db->reap_bytes, db->reap_last_keys, db->reap_last_micros};
+  pthread_mutex_unlock(&db->mutex);
+
+  intptr_t count = sizeof(stats) / sizeof(stats[0]);
+  Dart_Handle result = Dart_NewList(count);
+  for (intptr_t i = 0; i < count; i++) {
+    Dart_ListSetAt(result, i, Dart_NewInteger(stats[i]));
+  }
+
+  Dart_SetReturnValue(arguments, result);
+  Dart_ExitScope();
+}
+
+
+void syncIOStats(Dart_NativeArguments arguments) {  // (this)
+  Dart_EnterScope();
+
+  NativeDB *native_db;
+  Dart_Handle arg0 = Dart_GetNativeArgument(arguments, 0);
+  Dart_GetNativeInstanceField(arg0, 0, (intptr_t*) &native_db);
+
+  if (native_db->db == NULL) {
+    throwClosedException();
+    assert(false); // Not reached
+  }
+
+  IOStats* io_stats = &native_db->db->env->stats;
+  int64_t stats[] = {io_stats->bytes_read, io_stats->bytes_written, io_stats->syncs, io_stats->throttled_micros};
+
+  intptr_t count = sizeof(stats) / sizeof(stats[0]);
+  Dart_Handle result = Dart_NewList(count);
+  for (intptr_t i = 0; i < count; i++) {
+    Dart_ListSetAt(result, i, Dart_NewInteger(stats[i]));
+  }
+
+  Dart_SetReturnValue(arguments, result);
+  Dart_ExitScope();
+}
+
+
 void syncClose(Dart_NativeArguments arguments) {  // (this)
     Dart_EnterScope();
 
@@ -703,13 +2091,19 @@ struct FunctionLookup {
 
 FunctionLookup function_list[] = {
     {"DB_Open", dbOpen},
+    {"OpenPool_New", openPoolNew},
+    {"DB_Checkpoint", dbCheckpoint},
 
     {"SyncIterator_New", syncNew},
     {"SyncIterator_Next", syncNext},
+    {"SyncMergeIterator_New", syncMergeNew},
+    {"SyncMergeIterator_Next", syncMergeNext},
 
     {"SyncGet", syncGet},
     {"SyncPut", syncPut},
     {"SyncDelete", syncDelete},
+    {"SyncTtlStats", syncTtlStats},
+    {"SyncIOStats", syncIOStats},
     {"SyncClose", syncClose},
 
     {NULL, NULL}};
@@ -93,12 +93,30 @@ class LevelDB<K, V> extends NativeFieldWrapperClass2 {
 
   LevelDB._internal(this._keyEncoding, this._valueEncoding);
 
-  void _open(bool shared, SendPort port, String path, int blockSize,
-      bool createIfMissing, bool errorIfExists) native "DB_Open";
+  void _open(
+      bool shared,
+      SendPort port,
+      String path,
+      int blockSize,
+      bool createIfMissing,
+      bool errorIfExists,
+      bool ttl,
+      int reapIntervalMs,
+      _LevelOpenPool? pool,
+      bool warmUp,
+      List<Uint8List?> hotRanges,
+      bool reportProgress,
+      int compactionBytesPerSecond,
+      bool inMemory) native "DB_Open";
 
   Uint8List? _syncGet(Uint8List key) native "SyncGet";
-  void _syncPut(Uint8List key, Uint8List value, bool sync) native "SyncPut";
+  void _syncPut(
+      Uint8List key, Uint8List value, bool sync, bool hasTtl, int ttlMs)
+      native "SyncPut";
   void _syncDelete(Uint8List key) native "SyncDelete";
+  List<dynamic> _syncTtlStats() native "SyncTtlStats";
+  List<dynamic> _syncIOStats() native "SyncIOStats";
+  void _checkpoint(SendPort port, String destPath) native "DB_Checkpoint";
   void _syncClose() native "SyncClose";
 
   static LevelError? _getError(dynamic reply) {
@@ -148,13 +166,27 @@ class LevelDB<K, V> extends NativeFieldWrapperClass2 {
           {bool shared: false,
           int blockSize: 4096,
           bool createIfMissing: true,
-          bool errorIfExists: false}) =>
+          bool errorIfExists: false,
+          bool ttl: false,
+          Duration? reapInterval,
+          bool warmUp: false,
+          List<LevelKeyRange<String>> hotRanges: const [],
+          void onProgress(LevelOpenProgress progress)?,
+          int compactionBytesPerSecond: 0,
+          bool inMemory: false}) =>
       open<String, String>(
         path,
         shared: shared,
         blockSize: blockSize,
         createIfMissing: createIfMissing,
         errorIfExists: errorIfExists,
+        ttl: ttl,
+        reapInterval: reapInterval,
+        warmUp: warmUp,
+        hotRanges: hotRanges,
+        onProgress: onProgress,
+        compactionBytesPerSecond: compactionBytesPerSecond,
+        inMemory: inMemory,
         keyEncoding: utf8,
         valueEncoding: utf8,
       );
@@ -166,14 +198,28 @@ class LevelDB<K, V> extends NativeFieldWrapperClass2 {
           {bool shared: false,
           int blockSize: 4096,
           bool createIfMissing: true,
-          bool errorIfExists: false}) =>
+          bool errorIfExists: false,
+          bool ttl: false,
+          Duration? reapInterval,
+          bool warmUp: false,
+          List<LevelKeyRange<Uint8List>> hotRanges: const [],
+          void onProgress(LevelOpenProgress progress)?,
+          int compactionBytesPerSecond: 0,
+          bool inMemory: false}) =>
       open<Uint8List, Uint8List>(path,
           keyEncoding: identity,
           valueEncoding: identity,
           shared: shared,
           blockSize: blockSize,
           createIfMissing: createIfMissing,
-          errorIfExists: errorIfExists);
+          errorIfExists: errorIfExists,
+          ttl: ttl,
+          reapInterval: reapInterval,
+          warmUp: warmUp,
+          hotRanges: hotRanges,
+          onProgress: onProgress,
+          compactionBytesPerSecond: compactionBytesPerSecond,
+          inMemory: inMemory);
 
   /// Open a database at [path]
   ///
@@ -184,25 +230,184 @@ class LevelDB<K, V> extends NativeFieldWrapperClass2 {
   /// [keyEncoding] or [valueEncoding] must be specified. The given encoding will
   /// be used to encoding and decode keys or values respectively. The encodings must match the generic
   /// type of the database.
+  ///
+  /// If [ttl] is true every value is stored with an expiry time and [put] accepts a `ttl` duration. Expired
+  /// values are never returned by [get] or [getItems]. A database must always be opened with the same [ttl]
+  /// setting. If [reapInterval] is given a native thread deletes expired values from the database at this
+  /// interval. See [ttlStats].
+  ///
+  /// If [warmUp] is true the index and filter blocks of every table are loaded and each range in [hotRanges]
+  /// is read into the block cache before the returned future completes. [onProgress] is called when the
+  /// database is opened and when the warm up is finished.
+  ///
+  /// If [shared] is true and the database is already open or being opened by another call to [open] then
+  /// the settings of that call are used: [warmUp], [hotRanges] and the other options of this call are ignored
+  /// and [onProgress] is not called.
+  ///
+  /// If [compactionBytesPerSecond] is greater than 0 the rate at which background compactions write to disk is
+  /// limited so that they do not slow down reads and writes. If [inMemory] is true the database is stored in
+  /// memory and is lost when it is closed. See [ioStats] for the I/O performed by the database.
   static Future<LevelDB<K, V>> open<K, V>(String path,
-      {bool shared: false,
+          {bool shared: false,
+          int blockSize: 4096,
+          bool createIfMissing: true,
+          bool errorIfExists: false,
+          bool ttl: false,
+          Duration? reapInterval,
+          bool warmUp: false,
+          List<LevelKeyRange<K>> hotRanges: const [],
+          void onProgress(LevelOpenProgress progress)?,
+          int compactionBytesPerSecond: 0,
+          bool inMemory: false,
+          required convert.Codec<K, Uint8List> keyEncoding,
+          required convert.Codec<V, Uint8List> valueEncoding}) =>
+      _openInPool<K, V>(null, 0, path,
+          shared: shared,
+          blockSize: blockSize,
+          createIfMissing: createIfMissing,
+          errorIfExists: errorIfExists,
+          ttl: ttl,
+          reapInterval: reapInterval,
+          warmUp: warmUp,
+          hotRanges: hotRanges,
+          onProgress: onProgress,
+          compactionBytesPerSecond: compactionBytesPerSecond,
+          inMemory: inMemory,
+          keyEncoding: keyEncoding,
+          valueEncoding: valueEncoding);
+
+  /// Open a database at each of [paths]. The databases are opened by a pool of at most [concurrency] native
+  /// threads.
+  ///
+  /// The returned list is in the same order as [paths]. If any database fails to open the databases which
+  /// were opened are closed and the error is returned. [onProgress] is called as each database is opened and
+  /// warmed up. See [open] for information on the other parameters which apply to every database, including
+  /// how they are handled for a [shared] database which is already open.
+  static Future<List<LevelDB<K, V>>> openAll<K, V>(List<String> paths,
+      {int concurrency: 4,
+      bool shared: false,
       int blockSize: 4096,
       bool createIfMissing: true,
       bool errorIfExists: false,
+      bool ttl: false,
+      Duration? reapInterval,
+      bool warmUp: false,
+      List<LevelKeyRange<K>> hotRanges: const [],
+      void onProgress(LevelOpenProgress progress)?,
+      int compactionBytesPerSecond: 0,
+      bool inMemory: false,
+      required convert.Codec<K, Uint8List> keyEncoding,
+      required convert.Codec<V, Uint8List> valueEncoding}) {
+    if (concurrency < 1) {
+      throw new ArgumentError.value(
+          concurrency, 'concurrency', 'Must be at least 1');
+    }
+    _LevelOpenPool pool = new _LevelOpenPool(concurrency);
+    List<Future<LevelDB<K, V>>> futures = <Future<LevelDB<K, V>>>[];
+    for (int i = 0; i < paths.length; i++) {
+      futures.add(_openInPool<K, V>(pool, i, paths[i],
+          shared: shared,
+          blockSize: blockSize,
+          createIfMissing: createIfMissing,
+          errorIfExists: errorIfExists,
+          ttl: ttl,
+          reapInterval: reapInterval,
+          warmUp: warmUp,
+          hotRanges: hotRanges,
+          onProgress: onProgress,
+          compactionBytesPerSecond: compactionBytesPerSecond,
+          inMemory: inMemory,
+          keyEncoding: keyEncoding,
+          valueEncoding: valueEncoding));
+    }
+    return Future.wait(futures, cleanUp: (LevelDB<K, V> db) => db.close());
+  }
+
+  static Future<LevelDB<K, V>> _openInPool<K, V>(
+      _LevelOpenPool? pool, int index, String path,
+      {required bool shared,
+      required int blockSize,
+      required bool createIfMissing,
+      required bool errorIfExists,
+      required bool ttl,
+      required Duration? reapInterval,
+      required bool warmUp,
+      required List<LevelKeyRange<K>> hotRanges,
+      required void onProgress(LevelOpenProgress progress)?,
+      required int compactionBytesPerSecond,
+      required bool inMemory,
       required convert.Codec<K, Uint8List> keyEncoding,
       required convert.Codec<V, Uint8List> valueEncoding}) {
     Completer<LevelDB<K, V>> completer = new Completer<LevelDB<K, V>>();
     RawReceivePort replyPort = new RawReceivePort();
     LevelDB<K, V> db = new LevelDB<K, V>._internal(keyEncoding, valueEncoding);
     replyPort.handler = (dynamic result) {
+      if (result is List) {
+        onProgress!(new LevelOpenProgress._internal(path, index, result));
+        return;
+      }
       replyPort.close();
       if (_completeError(completer, result)) {
         return;
       }
       completer.complete(db);
     };
-    db._open(shared, replyPort.sendPort, path, blockSize, createIfMissing,
-        errorIfExists);
+    List<Uint8List?> hotRangesEncoded = <Uint8List?>[];
+    for (LevelKeyRange<K> range in hotRanges) {
+      K? gte = range.gte;
+      K? lt = range.lt;
+      hotRangesEncoded.add(gte == null ? null : keyEncoding.encode(gte));
+      hotRangesEncoded.add(lt == null ? null : keyEncoding.encode(lt));
+    }
+    db._open(
+        shared,
+        replyPort.sendPort,
+        path,
+        blockSize,
+        createIfMissing,
+        errorIfExists,
+        ttl,
+        reapInterval?.inMilliseconds ?? 0,
+        pool,
+        warmUp,
+        hotRangesEncoded,
+        onProgress != null,
+        compactionBytesPerSecond,
+        inMemory);
+    return completer.future;
+  }
+
+  /// Write a consistent copy of the database to [destPath] without blocking writers.
+  ///
+  /// The copy is made on a background thread whilst the database stays open in this and other isolates.
+  /// Table files are hard linked where possible so the checkpoint takes little time and disk space. If [destPath]
+  /// contains an earlier checkpoint of this database then only tables written since then are linked or copied,
+  /// and the earlier checkpoint is left intact if this one fails.
+  ///
+  /// [onProgress] is called after each file is written to [destPath].
+  Future<Null> checkpoint(String destPath,
+      {void onProgress(LevelCheckpointProgress progress)?}) {
+    Completer<Null> completer = new Completer<Null>();
+    RawReceivePort replyPort = new RawReceivePort();
+    replyPort.handler = (dynamic result) {
+      if (result is List) {
+        if (onProgress != null) {
+          onProgress(new LevelCheckpointProgress._internal(result));
+        }
+        return;
+      }
+      replyPort.close();
+      if (_completeError(completer, result)) {
+        return;
+      }
+      completer.complete();
+    };
+    try {
+      _checkpoint(replyPort.sendPort, destPath);
+    } catch (_) {
+      replyPort.close();
+      rethrow;
+    }
     return completer.future;
   }
 
@@ -224,10 +429,15 @@ class LevelDB<K, V> extends NativeFieldWrapperClass2 {
   }
 
   /// Set a key to a value.
-  void put(K key, V value, {bool sync: false}) {
+  ///
+  /// If [ttl] is given the value expires after this duration. The database must have been opened with `ttl: true`.
+  /// A [ttl] of zero or less stores a value which has already expired.
+  void put(K key, V value, {bool sync: false, Duration? ttl}) {
     Uint8List keyEnc = _keyEncoding.encode(key);
     Uint8List valueEnc = _valueEncoding.encode(value);
-    _syncPut(keyEnc, valueEnc, sync);
+    // Expiry times are in milliseconds. Round up so that a ttl of less than a millisecond still expires.
+    int ttlMs = ttl == null ? 0 : (ttl.inMicroseconds + 999) ~/ 1000;
+    _syncPut(keyEnc, valueEnc, sync, ttl != null, ttlMs);
   }
 
   /// Remove a key from the database
@@ -236,6 +446,12 @@ class LevelDB<K, V> extends NativeFieldWrapperClass2 {
     _syncDelete(keyEnc);
   }
 
+  /// Statistics about the file I/O performed by the database since it was opened.
+  LevelIOStats get ioStats => new LevelIOStats._internal(_syncIOStats());
+
+  /// Statistics about expired values deleted by the reaper thread.
+  LevelTtlStats get ttlStats => new LevelTtlStats._internal(_syncTtlStats());
+
   /// Return an [Iterable] which will iterate through the db in key byte-collated order.
   ///
   /// To start iteration from a particular point use [gt] or [gte] and the iterator will start at the first key
@@ -254,6 +470,179 @@ class LevelDB<K, V> extends NativeFieldWrapperClass2 {
     return new LevelIterable<K, V>._internal(this, limit, fillCache,
         gt == null ? gte : gt, gt == null, lt == null ? lte : lt, lt == null);
   }
+
+  /// Return an [Iterable] which iterates through several databases in a single key byte-collated order.
+  ///
+  /// The merge is performed natively so iterating a merge costs one native call per item returned. The range
+  /// parameters have the same meaning as in [getItems] and apply to every database. [limit] limits the total
+  /// number of items returned by the merge.
+  ///
+  /// When a key exists in more than one database [policy] decides which items are returned. Keys and values are
+  /// decoded with the encodings of the first database in [dbs].
+  static LevelMergeIterable<K, V> merge<K, V>(List<LevelDB<K, V>> dbs,
+      {K? gt,
+      K? gte,
+      K? lt,
+      K? lte,
+      int limit: -1,
+      bool fillCache: true,
+      LevelMergePolicy policy: LevelMergePolicy.firstWins}) {
+    if (dbs.isEmpty) {
+      throw new ArgumentError.value(dbs, 'dbs', 'Must not be empty');
+    }
+    return new LevelMergeIterable<K, V>._internal(
+        new List<LevelDB<K, V>>.unmodifiable(dbs),
+        limit,
+        fillCache,
+        gt == null ? gte : gt,
+        gt == null,
+        lt == null ? lte : lt,
+        lt == null,
+        policy);
+  }
+}
+
+/// How [LevelDB.merge] handles a key which exists in more than one database.
+enum LevelMergePolicy {
+  /// Return only the item from the database which is first in the list of merged databases.
+  firstWins,
+
+  /// Return the item from every database. Items with the same key are returned in the order of the list of
+  /// merged databases.
+  emitAll,
+}
+
+/// File I/O statistics of a database. See [LevelDB.ioStats].
+///
+/// The statistics are shared by every [LevelDB] referencing the same shared database.
+class LevelIOStats {
+  /// The number of bytes read from files.
+  final int bytesRead;
+
+  /// The number of bytes written to files.
+  final int bytesWritten;
+
+  /// The number of file syncs.
+  final int syncs;
+
+  /// The total time compactions have waited because of the `compactionBytesPerSecond` limit.
+  final Duration throttled;
+
+  LevelIOStats._internal(List<dynamic> stats)
+      : bytesRead = stats[0] as int,
+        bytesWritten = stats[1] as int,
+        syncs = stats[2] as int,
+        throttled = new Duration(microseconds: stats[3] as int);
+}
+
+/// Statistics reported by the ttl reaper. See [LevelDB.open].
+class LevelTtlStats {
+  /// The number of completed sweeps of the database.
+  final int sweeps;
+
+  /// The total number of expired keys deleted.
+  final int keysReaped;
+
+  /// The total size in bytes of the expired keys and values deleted. The disk space is reclaimed when the
+  /// deletions are compacted.
+  final int bytesReclaimed;
+
+  /// The number of expired keys deleted by the last sweep.
+  final int lastSweepKeys;
+
+  /// The time taken by the last sweep.
+  final Duration lastSweepDuration;
+
+  LevelTtlStats._internal(List<dynamic> stats)
+      : sweeps = stats[0] as int,
+        keysReaped = stats[1] as int,
+        bytesReclaimed = stats[2] as int,
+        lastSweepKeys = stats[3] as int,
+        lastSweepDuration = new Duration(microseconds: stats[4] as int);
+
+  /// The number of keys deleted per second by the last sweep.
+  double get sweepRate => lastSweepDuration.inMicroseconds == 0
+      ? 0.0
+      : lastSweepKeys * 1000000 / lastSweepDuration.inMicroseconds;
+}
+
+/// A range of keys `>= gte` and `< lt`. A null bound leaves that end of the range unbounded.
+class LevelKeyRange<K> {
+  /// The first key in the range.
+  final K? gte;
+
+  /// The key after the end of the range.
+  final K? lt;
+
+  /// Create a key range.
+  const LevelKeyRange({this.gte, this.lt});
+}
+
+/// A phase of opening a database. See [LevelOpenProgress].
+enum LevelOpenPhase {
+  /// The database files have been opened.
+  opened,
+
+  /// The warm up has finished. The open future completes after this phase.
+  ///
+  /// Not reported for a shared database which was already open or being opened. See [LevelDB.open].
+  warmed,
+}
+
+/// Progress of opening a database with [LevelDB.open] or [LevelDB.openAll].
+class LevelOpenProgress {
+  /// The path of the database.
+  final String path;
+
+  /// The index of the database in the list passed to [LevelDB.openAll].
+  final int index;
+
+  /// The phase which has finished.
+  final LevelOpenPhase phase;
+
+  /// The time since the open started.
+  final Duration elapsed;
+
+  /// The number of tables loaded into the table cache by the warm up.
+  final int tablesWarmed;
+
+  /// The number of bytes of keys and values read from the hot ranges by the warm up.
+  final int bytesWarmed;
+
+  LevelOpenProgress._internal(this.path, this.index, List<dynamic> progress)
+      : phase = LevelOpenPhase.values[progress[0] as int],
+        elapsed = new Duration(microseconds: progress[1] as int),
+        tablesWarmed = progress[2] as int,
+        bytesWarmed = progress[3] as int;
+}
+
+class _LevelOpenPool extends NativeFieldWrapperClass2 {
+  _LevelOpenPool(int concurrency) {
+    _init(concurrency);
+  }
+
+  void _init(int concurrency) native "OpenPool_New";
+}
+
+/// Progress of a [LevelDB.checkpoint].
+class LevelCheckpointProgress {
+  /// The number of files written to the checkpoint.
+  final int filesDone;
+
+  /// The total number of files in the checkpoint.
+  final int filesTotal;
+
+  /// The number of bytes of table files hard linked into the checkpoint.
+  final int bytesLinked;
+
+  /// The number of bytes copied into the checkpoint.
+  final int bytesCopied;
+
+  LevelCheckpointProgress._internal(List<dynamic> progress)
+      : filesDone = progress[0] as int,
+        filesTotal = progress[1] as int,
+        bytesLinked = progress[2] as int,
+        bytesCopied = progress[3] as int;
 }
 
 /// A key-value pair returned by the iterator
@@ -272,9 +661,7 @@ class LevelIterator<K, V> extends NativeFieldWrapperClass2
   final convert.Codec<K, Uint8List> _keyEncoding;
   final convert.Codec<V, Uint8List> _valueEncoding;
 
-  LevelIterator._internal(LevelIterable<K, V> it)
-      : _keyEncoding = it._db._keyEncoding,
-        _valueEncoding = it._db._valueEncoding;
+  LevelIterator._internal(this._keyEncoding, this._valueEncoding);
 
   void _init(LevelDB<K, V> db, int limit, bool fillCache, Uint8List? gt,
       bool isGtClosed, Uint8List? lt, bool isLtClosed) native "SyncIterator_New";
@@ -346,7 +733,8 @@ class LevelIterable<K, V> extends IterableBase<LevelItem<K, V>> {
 
   @override
   LevelIterator<K, V> get iterator {
-    LevelIterator<K, V> ret = new LevelIterator<K, V>._internal(this);
+    LevelIterator<K, V> ret =
+        new LevelIterator<K, V>._internal(_db._keyEncoding, _db._valueEncoding);
     Uint8List? ltEncoded;
     if (_lt != null) {
       ltEncoded = _db._keyEncoding.encode(_lt!);
@@ -377,3 +765,77 @@ class LevelIterable<K, V> extends IterableBase<LevelItem<K, V>> {
     }
   }
 }
+
+class _LevelMergeIterator<K, V> extends LevelIterator<K, V> {
+  // Keep a reference to the databases so they are not finalized whilst iterating.
+  final List<LevelDB<K, V>> _dbs;
+
+  _LevelMergeIterator(List<LevelDB<K, V>> dbs)
+      : _dbs = dbs,
+        super._internal(dbs.first._keyEncoding, dbs.first._valueEncoding);
+
+  void _initMerge(
+      List<LevelDB<K, V>> dbs,
+      int limit,
+      bool fillCache,
+      Uint8List? gt,
+      bool isGtClosed,
+      Uint8List? lt,
+      bool isLtClosed,
+      bool emitAll) native "SyncMergeIterator_New";
+  @override
+  Uint8List? _next() native "SyncMergeIterator_Next";
+}
+
+/// An [Iterable<LevelItem>] for iterating over the key-value pairs of several databases. See [LevelDB.merge].
+class LevelMergeIterable<K, V> extends IterableBase<LevelItem<K, V>> {
+  final List<LevelDB<K, V>> _dbs;
+
+  final int _limit;
+  final bool _fillCache;
+
+  final K? _gt;
+  final bool _isGtClosed;
+
+  final K? _lt;
+  final bool _isLtClosed;
+
+  final LevelMergePolicy _policy;
+
+  LevelMergeIterable._internal(this._dbs, this._limit, this._fillCache, this._gt,
+      this._isGtClosed, this._lt, this._isLtClosed, this._policy);
+
+  @override
+  LevelIterator<K, V> get iterator {
+    _LevelMergeIterator<K, V> ret = new _LevelMergeIterator<K, V>(_dbs);
+    convert.Codec<K, Uint8List> keyEncoding = _dbs.first._keyEncoding;
+    Uint8List? ltEncoded;
+    if (_lt != null) {
+      ltEncoded = keyEncoding.encode(_lt!);
+    }
+    Uint8List? gtEncoded;
+    if (_gt != null) {
+      gtEncoded = keyEncoding.encode(_gt!);
+    }
+
+    ret._initMerge(_dbs, _limit, _fillCache, gtEncoded, _isGtClosed, ltEncoded,
+        _isLtClosed, _policy == LevelMergePolicy.emitAll);
+    return ret;
+  }
+
+  /// Returns an [Iterable] of the keys in the merged dbs
+  Iterable<K> get keys sync* {
+    LevelIterator<K, V> it = iterator;
+    while (it.moveNext()) {
+      yield it.currentKey;
+    }
+  }
+
+  /// Returns an [Iterable] of the values in the merged dbs
+  Iterable<V> get values sync* {
+    LevelIterator<K, V> it = iterator;
+    while (it.moveNext()) {
+      yield it.currentValue;
+    }
+  }
+}
@@ -2,18 +2,24 @@ import 'dart:io';
 import 'dart:async';
 import 'dart:convert';
 import 'dart:isolate';
+import 'dart:math';
 import 'dart:typed_data';
 
 import 'package:test/test.dart';
 import 'package:leveldb/leveldb.dart';
 
 Future<LevelDB<String, String>> _openTestDB(
-    {int index: 0, bool shared: false, bool clean: true}) async {
+    {int index: 0,
+    bool shared: false,
+    bool clean: true,
+    bool ttl: false,
+    Duration? reapInterval}) async {
   Directory d = new Directory('/tmp/test-level-db-dart-$index');
   if (clean && d.existsSync()) {
     await d.delete(recursive: true);
   }
-  return LevelDB.openUtf8('/tmp/test-level-db-dart-$index', shared: shared);
+  return LevelDB.openUtf8('/tmp/test-level-db-dart-$index',
+      shared: shared, ttl: ttl, reapInterval: reapInterval);
 }
 
 Future<LevelDB<K, V>> _openTestDBEnc<K, V>(
@@ -404,6 +410,344 @@ void main() {
     expect(db1.get("k1"), "v");
   });
 
+  test('TTL expiry', () async {
+    LevelDB<String, String> db = await _openTestDB(ttl: true);
+
+    db.put("a", "1", ttl: const Duration(milliseconds: 1));
+    db.put("b", "2");
+    db.put("c", "3", ttl: const Duration(milliseconds: 1));
+    db.put("d", "4", ttl: const Duration(hours: 1));
+
+    // A ttl of zero, less than zero or less than a millisecond does not store a value which never expires.
+    db.put("e", "5", ttl: Duration.zero);
+    db.put("f", "6", ttl: const Duration(seconds: -1));
+    db.put("g", "7", ttl: const Duration(microseconds: 500));
+    expect(db.get("e"), null);
+    expect(db.get("f"), null);
+
+    await new Future<Null>.delayed(const Duration(milliseconds: 10));
+    expect(db.get("g"), null);
+
+    expect(db.get("a"), null);
+    expect(db.get("b"), "2");
+    expect(db.get("d"), "4");
+    expect(db.getItems().keys.toList(), equals(<String>["b", "d"]));
+    expect(db.getItems(gte: "c").keys.toList(), equals(<String>["d"]));
+    expect(db.getItems(limit: 1).values.toList(), equals(<String>["2"]));
+
+    // Overwriting an expired key makes it visible again.
+    db.put("a", "5");
+    expect(db.get("a"), "5");
+    db.close();
+
+    // The db must be reopened with the same ttl setting.
+    expect(_openTestDB(clean: false), throwsA(_isInvalidArgumentError));
+    db = await _openTestDB(ttl: true, clean: false);
+    expect(db.get("a"), "5");
+    db.close();
+
+    // A ttl can only be given if the db was opened with ttl enabled.
+    LevelDB<String, String> db1 = await _openTestDB();
+    expect(() => db1.put("a", "1", ttl: const Duration(seconds: 1)),
+        throwsA(_isInvalidArgumentError));
+    expect(() => db1.put("a", "1", ttl: Duration.zero),
+        throwsA(_isInvalidArgumentError));
+    db1.close();
+    expect(_openTestDB(ttl: true, clean: false),
+        throwsA(_isInvalidArgumentError));
+  });
+
+  test('TTL reaper', () async {
+    LevelDB<String, String> db = await _openTestDB(
+        ttl: true, reapInterval: const Duration(milliseconds: 20));
+
+    for (int i in new Iterable<int>.generate(100)) {
+      db.put("k$i", "v", ttl: const Duration(milliseconds: 1));
+    }
+    db.put("keep", "v");
+
+    LevelTtlStats stats = db.ttlStats;
+    while (stats.keysReaped < 100) {
+      await new Future<Null>.delayed(const Duration(milliseconds: 20));
+      stats = db.ttlStats;
+    }
+    expect(stats.keysReaped, 100);
+    expect(stats.bytesReclaimed, greaterThan(0));
+    expect(stats.sweeps, greaterThan(0));
+    expect(db.get("keep"), "v");
+    db.close();
+
+    expect(() => db.ttlStats, throwsA(_isClosedError));
+  });
+
+  test('Checkpoint', () async {
+    Directory d = new Directory('/tmp/test-level-db-dart-checkpoint');
+    if (d.existsSync()) {
+      await d.delete(recursive: true);
+    }
+
+    LevelDB<String, String> db = await _openTestDB(shared: true);
+    for (int i in new Iterable<int>.generate(1000)) {
+      db.put("k$i", "v$i");
+    }
+    // Reopening the db writes the log to a table.
+    db.close();
+    db = await _openTestDB(shared: true, clean: false);
+
+    List<LevelCheckpointProgress> progress = <LevelCheckpointProgress>[];
+    await db.checkpoint(d.path, onProgress: progress.add);
+    LevelCheckpointProgress first = progress.last;
+    expect(first.filesDone, first.filesTotal);
+    expect(first.bytesLinked, greaterThan(0));
+
+    // The db is still usable after a checkpoint.
+    db.put("after", "v");
+
+    // Checkpoint again into the same directory. The table is already in the checkpoint so it is not linked or
+    // copied again. Only the MANIFEST and log are copied.
+    progress.clear();
+    await db.checkpoint(d.path, onProgress: progress.add);
+    expect(progress.last.bytesLinked, 0);
+    expect(progress.last.bytesCopied, lessThan(first.bytesLinked));
+    db.close();
+
+    LevelDB<String, String> copy = await LevelDB.openUtf8(d.path);
+    expect(copy.get("k0"), "v0");
+    expect(copy.get("k999"), "v999");
+    expect(copy.get("after"), "v");
+    expect(copy.getItems().length, 1001);
+    copy.close();
+
+    expect(() => db.checkpoint(d.path), throwsA(_isClosedError));
+  });
+
+  test('Failed checkpoint keeps the earlier checkpoint', () async {
+    Directory d = new Directory('/tmp/test-level-db-dart-checkpoint-failed');
+    if (d.existsSync()) {
+      await d.delete(recursive: true);
+    }
+
+    LevelDB<String, String> db = await _openTestDB();
+    db.put("k1", "v1");
+    await db.checkpoint(d.path);
+
+    // Make the checkpoint fail after the MANIFEST and log have been copied by putting a directory where CURRENT
+    // is written.
+    db.put("k2", "v2");
+    Directory currentTmp = new Directory('${d.path}/CURRENT.dbtmp')..createSync();
+    try {
+      await db.checkpoint(d.path);
+      expect(true, equals(false)); // Should not happen.
+    } on LevelIOError {
+      expect(true, equals(true)); // Should happen.
+    }
+    currentTmp.deleteSync();
+    db.close();
+
+    LevelDB<String, String> copy = await LevelDB.openUtf8(d.path);
+    expect(copy.get("k1"), "v1");
+    expect(copy.get("k2"), null);
+    copy.close();
+  });
+
+  test('Merge dbs', () async {
+    LevelDB<String, String> db1 = await _openTestDB();
+    LevelDB<String, String> db2 = await _openTestDB(index: 1);
+    LevelDB<String, String> db3 = await _openTestDB(index: 2);
+
+    db1.put("a", "1");
+    db1.put("c", "1");
+    db1.put("e", "1");
+    db2.put("b", "2");
+    db2.put("c", "2");
+    db2.put("f", "2");
+
+    List<LevelDB<String, String>> dbs = <LevelDB<String, String>>[
+      db1,
+      db2,
+      db3
+    ];
+    expect(LevelDB.merge(dbs).keys.toList(),
+        equals(<String>["a", "b", "c", "e", "f"]));
+    expect(LevelDB.merge(dbs).values.toList(),
+        equals(<String>["1", "2", "1", "1", "2"]));
+    expect(LevelDB.merge(dbs.reversed.toList()).values.toList(),
+        equals(<String>["1", "2", "2", "1", "2"]));
+    expect(
+        LevelDB.merge(dbs, policy: LevelMergePolicy.emitAll)
+            .values
+            .toList(),
+        equals(<String>["1", "2", "1", "2", "1", "2"]));
+
+    expect(LevelDB.merge(dbs, gt: "a", lte: "e").keys.toList(),
+        equals(<String>["b", "c", "e"]));
+    expect(LevelDB.merge(dbs, gte: "c", lt: "f").keys.toList(),
+        equals(<String>["c", "e"]));
+    expect(LevelDB.merge(dbs, limit: 2).keys.toList(),
+        equals(<String>["a", "b"]));
+    expect(LevelDB.merge(<LevelDB<String, String>>[db3]).length, 0);
+
+    Iterator<LevelItem<String, String>> it = LevelDB.merge(dbs).iterator;
+    expect(it.moveNext(), true);
+    db2.close();
+    expect(() => it.moveNext(), throwsA(_isClosedError));
+    expect(() => LevelDB.merge(dbs).toList(), throwsA(_isClosedError));
+
+    db1.close();
+    db3.close();
+  });
+
+  test('Open all', () async {
+    List<String> paths = <String>[];
+    for (int i in new Iterable<int>.generate(3)) {
+      LevelDB<String, String> db = await _openTestDB(index: i);
+      db.put("k$i", "v$i");
+      db.close();
+      paths.add('/tmp/test-level-db-dart-$i');
+    }
+
+    List<LevelOpenProgress> progress = <LevelOpenProgress>[];
+    List<LevelDB<String, String>> dbs = await LevelDB.openAll(paths,
+        concurrency: 2,
+        warmUp: true,
+        hotRanges: <LevelKeyRange<String>>[
+          const LevelKeyRange<String>(gte: "k", lt: "l")
+        ],
+        onProgress: progress.add,
+        keyEncoding: LevelDB.utf8,
+        valueEncoding: LevelDB.utf8);
+
+    expect(dbs.length, 3);
+    for (int i in new Iterable<int>.generate(3)) {
+      expect(dbs[i].get("k$i"), "v$i");
+      List<LevelOpenProgress> dbProgress =
+          progress.where((LevelOpenProgress p) => p.index == i).toList();
+      expect(dbProgress.map((LevelOpenProgress p) => p.phase).toList(),
+          equals(<LevelOpenPhase>[LevelOpenPhase.opened, LevelOpenPhase.warmed]));
+      expect(dbProgress.first.path, paths[i]);
+      expect(dbProgress.last.bytesWarmed, greaterThan(0));
+      // Recovering the log when the db was reopened wrote a table.
+      expect(dbProgress.last.tablesWarmed, greaterThan(0));
+      dbs[i].close();
+    }
+
+    expect(
+        LevelDB.openAll(
+            <String>[paths.first, '/tmp/test-level-db-dart-DOES-NOT-EXIST'],
+            createIfMissing: false,
+            keyEncoding: LevelDB.utf8,
+            valueEncoding: LevelDB.utf8),
+        throwsA(_isInvalidArgumentError));
+  });
+
+  test('IO stats', () async {
+    LevelDB<String, String> db = await _openTestDB();
+    LevelIOStats stats = db.ioStats;
+    db.put("k1", "v1", sync: true);
+    db.put("k2", "v2", sync: true);
+    expect(db.ioStats.bytesWritten, greaterThan(stats.bytesWritten));
+    expect(db.ioStats.syncs, greaterThanOrEqualTo(stats.syncs + 2));
+    db.close();
+
+    expect(() => db.ioStats, throwsA(_isClosedError));
+
+    // Recovering the log when the db is opened reads it.
+    db = await _openTestDB(clean: false);
+    expect(db.ioStats.bytesRead, greaterThan(0));
+    expect(db.get("k2"), "v2");
+    db.close();
+  });
+
+  test('In memory db', () async {
+    String path = '/tmp/test-level-db-dart-memory';
+    LevelDB<String, String> db = await LevelDB.open(path,
+        inMemory: true,
+        compactionBytesPerSecond: 1024 * 1024,
+        keyEncoding: LevelDB.utf8,
+        valueEncoding: LevelDB.utf8);
+    db.put("k1", "v1", sync: true);
+    expect(db.get("k1"), "v1");
+    expect(db.ioStats.bytesWritten, greaterThan(0));
+    expect(db.ioStats.syncs, greaterThan(0));
+    expect(new Directory(path).existsSync(), false);
+
+    // A checkpoint of an in memory db is written to disk.
+    Directory d = new Directory('/tmp/test-level-db-dart-memory-checkpoint');
+    if (d.existsSync()) {
+      await d.delete(recursive: true);
+    }
+    await db.checkpoint(d.path);
+    db.close();
+
+    LevelDB<String, String> copy = await LevelDB.openUtf8(d.path);
+    expect(copy.get("k1"), "v1");
+    copy.close();
+
+    // The data is lost when the db is closed.
+    db = await LevelDB.openUtf8(path, inMemory: true);
+    expect(db.get("k1"), null);
+    db.close();
+  });
+
+  test('Compaction rate limit', () async {
+    LevelDB<String, String> db = await LevelDB.open(
+        '/tmp/test-level-db-dart-rate-limit',
+        inMemory: true,
+        compactionBytesPerSecond: 4 * 1024 * 1024,
+        keyEncoding: LevelDB.utf8,
+        valueEncoding: LevelDB.utf8);
+
+    // Random values so that the tables are not compressed.
+    Random random = new Random(0);
+    String randomValue() => new String.fromCharCodes(new Iterable<int>.generate(
+        1000, (int _) => 'a'.codeUnitAt(0) + random.nextInt(26)));
+
+    // Writes to the log are never throttled. 2MB is less than the memtable size so no table is written.
+    for (int i = 0; i < 2000; i++) {
+      db.put("k$i", randomValue());
+    }
+    expect(db.ioStats.bytesWritten, greaterThan(2000 * 1000));
+    expect(db.ioStats.throttled, Duration.zero);
+
+    // Fill the memtable so that it is flushed to a table.
+    for (int i = 2000; i < 5000; i++) {
+      db.put("k$i", randomValue());
+    }
+    while (db.ioStats.throttled == Duration.zero) {
+      await new Future<Null>.delayed(const Duration(milliseconds: 50));
+    }
+    expect(db.ioStats.throttled, greaterThan(Duration.zero));
+    expect(db.get("k0"), isNotNull);
+    db.close();
+  });
+
+  test('Compaction rate limit after idle', () async {
+    // At this rate the refill for an idle gap of about a second overflows unless it is clamped to the burst.
+    LevelDB<String, String> db = await LevelDB.open(
+        '/tmp/test-level-db-dart-rate-limit-idle',
+        inMemory: true,
+        compactionBytesPerSecond: 1 << 43,
+        keyEncoding: LevelDB.utf8,
+        valueEncoding: LevelDB.utf8);
+    await new Future<Null>.delayed(const Duration(seconds: 2));
+
+    Random random = new Random(0);
+    String randomValue() => new String.fromCharCodes(new Iterable<int>.generate(
+        1000, (int _) => 'a'.codeUnitAt(0) + random.nextInt(26)));
+    for (int i = 0; i < 5000; i++) {
+      db.put("k$i", randomValue());
+    }
+    // The memtable flush writes a table of about the same size as the log.
+    int flushedBytes = db.ioStats.bytesWritten * 3 ~/ 2;
+    Stopwatch stopwatch = new Stopwatch()..start();
+    while (db.ioStats.bytesWritten < flushedBytes && stopwatch.elapsed < const Duration(seconds: 10)) {
+      await new Future<Null>.delayed(const Duration(milliseconds: 50));
+    }
+    expect(db.ioStats.bytesWritten, greaterThanOrEqualTo(flushedBytes));
+    expect(db.ioStats.throttled, lessThan(const Duration(seconds: 1)));
+    db.close();
+  });
+
   test('Shared db isolates test', () async {
     // Spawn 2 isolates of which open and close the same shared db a lot in an attempt to find race conditions
     // in opening and closing the db.